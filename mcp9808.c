@@ -3,124 +3,2284 @@
  *
  * Fetches the I²C address from the device tree 'reg' property
  * and sets resolution to 0.125°C, exposing temperature reads
- * via a character device.
+ * via a character device.  Without a DT node the sensor can be
+ * instantiated from userspace (new_device), e.g. on i2c-stub.
+ *
+ * Sample and alert event records live in fixed pools allocated at
+ * probe time, so neither the read path nor the ALERT interrupt thread
+ * ever calls the general allocator.  Each pool is a ring indexed by
+ * sequence number; when a reader falls more than a pool behind, the
+ * oldest records are recycled and counted as overruns.
+ *
+ * Each open file may request its own sampling rate.  The device is
+ * polled at the fastest requested rate (never faster than one
+ * conversion) and binary readers decimate the shared sample stream down
+ * to their own rate, so bus traffic depends only on the fastest
+ * subscriber.
+ *
+ * Sensors sharing an adapter share one polling schedule.  Every tick,
+ * all sensors that are due are read with a single i2c_transfer() of
+ * write/read message pairs when the adapter supports plain I²C, falling
+ * back to one SMBus word read per sensor otherwise.
+ *
+ * The latest sample of every sensor is also mirrored into one page that
+ * /dev/mcp9808-all maps read-only, each entry guarded by a sequence
+ * counter, so reading all sensors costs a few loads and no syscall.
+ *
+ * Optionally every sample is also appended, as one 8-byte store, to a
+ * ring in a reserved persistent RAM region (blackbox_addr/size, e.g.
+ * reserved with memmap=).  At load time the ring left by the previous
+ * boot is copied out and served from /dev/mcp9808-blackbox, so the
+ * temperature history leading up to a crash survives the reboot.
+ *
+ * Each sample also feeds a per-device Holt estimator (level and trend,
+ * Q16 fixed point) whose forecast and time-to-limit estimates travel in
+ * the sample record, with an early-warning event when TUPPER or TCRIT
+ * is forecast to be crossed within the horizon.
+ *
+ * Every open file may also register its own software thresholds.  They
+ * are kept in one per-device rbtree sorted by temperature, so a new
+ * sample only visits the thresholds between the previous and the new
+ * value; crossing events go to the owning file's private queue and are
+ * merged with the shared events by sequence number.
+ *
+ * /dev/mcp9808-all also answers history queries: the sample pools of
+ * several sensors resampled onto one time grid in a single ioctl.
+ *
+ * For longer history every sensor keeps round-robin tiers of 1 s, 1 min
+ * and 1 h points (min/max/mean/count) of fixed size.  Each sample only
+ * updates the open second; a point that closes is folded into the open
+ * point of the tier above, so consolidation costs O(1) per sample.
+ * History queries reaching back past the sample pool use the tiers.
+ *
+ * A temperature sitting on a limit can make ALERT fire continuously.
+ * Past alert_storm_limit alerts in a second the driver switches the
+ * sensor to comparator mode with 6°C hysteresis and only counts further
+ * alerts in the hard IRQ handler, masking the line if even that exceeds
+ * the budget.  A delayed work then reports the storm as one summary
+ * event per period and restores interrupt mode once it has calmed down,
+ * backing off exponentially while it has not.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/i2c.h>
+#include <linux/of.h>
+#include <linux/of_device.h>
+#include <linux/cdev.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/bitops.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
+#include <linux/math64.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/idr.h>
+#include <linux/gpio/consumer.h>
+#include <linux/gpio/driver.h>
+#include <linux/mm.h>
+#include <linux/io.h>
+#include <linux/vmalloc.h>
+#include <linux/atomic.h>
+#include <linux/log2.h>
+#include <linux/rbtree.h>
+#include <linux/kfifo.h>
+#include <linux/kref.h>
+#include <linux/rwsem.h>
+#include <linux/overflow.h>
+#include <linux/sort.h>
+#include <linux/sched.h>
+#include <linux/version.h>
+
+#include "mcp9808.h"
+
+#define MCP9808_CONFIG_REG   0x01    /* Configuration register */
+#define MCP9808_TUPPER_REG   0x02    /* Alert upper limit */
+#define MCP9808_TLOWER_REG   0x03    /* Alert lower limit */
+#define MCP9808_TCRIT_REG    0x04    /* Critical limit */
+#define MCP9808_TEMP_REG     0x05    /* Temperature register */
+#define MCP9808_RES_REG      0x08    /* Resolution register */
+#define MCP9808_RESOLUTION   0x02    /* Set resolution to 0.125°C */
+#define DEVICE_NAME          "mcp9808"
+#define MCP9808_MAX_DEVICES  MCP9808_LATEST_ENTRIES
+#define MCP9808_ALL_MINOR    MCP9808_MAX_DEVICES     /* /dev/mcp9808-all */
+#define MCP9808_BB_MINOR     (MCP9808_MAX_DEVICES + 1) /* /dev/mcp9808-blackbox */
+#define MCP9808_NR_MINORS    (MCP9808_MAX_DEVICES + 2)
+
+#define MCP9808_BB_MAGIC     0x3242434d  /* "MCB2" */
+#define MCP9808_BB_TICK_SHIFT 23         /* record time unit, 2^23 ns */
+
+#define MCP9808_HOLT_ALPHA   19661       /* level smoothing, 0.3 in Q16 */
+#define MCP9808_HOLT_BETA    6554        /* trend smoothing, 0.1 in Q16 */
+#define MCP9808_HORIZON_MAX_MS 3600000   /* forecasts and gaps cap at 1 h */
+/* keep the Q16 arithmetic far from overflow: ±250°C, ±1000°C/s */
+#define MCP9808_HOLT_LEVEL_MAX ((s64)2500000 << 16)
+#define MCP9808_HOLT_TREND_MAX ((s64)10000000 << 16)
+
+#define MCP9808_CFG_ALERT_MOD   BIT(0)  /* 1 = interrupt, 0 = comparator */
+#define MCP9808_CFG_ALERT_CNT   BIT(3)  /* ALERT output enable */
+#define MCP9808_CFG_INT_CLEAR   BIT(5)  /* clear latched interrupt */
+#define MCP9808_CFG_HYST_6C     (3 << 9) /* THYST = 6°C */
+
+#define MCP9808_STORM_BACKOFF_MS     1000   /* first storm period */
+#define MCP9808_STORM_BACKOFF_MAX_MS 32000
+
+#define MCP9808_TEMP_MIN     (-400000)   /* -40°C, datasheet range */
+#define MCP9808_TEMP_MAX     1250000     /* 125°C */
+
+#define MCP9808_SAMPLE_POOL  256     /* sample records per device, power of 2 */
+#define MCP9808_EVENT_POOL   64      /* event records per device, power of 2 */
+#define MCP9808_READ_BATCH   8       /* samples copied per lock hold */
+#define MCP9808_FILE_EVENTS  64      /* threshold events per file, power of 2 */
+#define MCP9808_MAX_THRESHOLDS 4096  /* software thresholds per file */
+#define MCP9808_HISTORY_MAX_POINTS 65536 /* grid points per history query */
+#define MCP9808_TIER_CHUNK   256     /* tier cells copied per d->lock hold */
+
+/* consolidation tier intervals, in seconds */
+static const u32 mcp9808_tier_s[MCP9808_NR_TIERS] = { 1, 60, 3600 };
+
+/* tCONV at 0.125°C resolution; reads faster than this repeat a value */
+#define MCP9808_CONV_NS      (130 * NSEC_PER_MSEC)
+
+/*
+ * ALERT line for setups whose firmware does not describe it, such as a
+ * gpio-sim chip in a test VM.  One line cannot serve several sensors,
+ * so it goes to the first sensor bound; needs Linux 6.7 or later.
+ */
+static char *alert_chip;
+module_param(alert_chip, charp, 0444);
+MODULE_PARM_DESC(alert_chip, "Label of the GPIO chip carrying ALERT of the first sensor");
+static unsigned int alert_line;
+module_param(alert_line, uint, 0444);
+MODULE_PARM_DESC(alert_line, "Line of alert_chip carrying ALERT");
+static unsigned int alert_storm_limit = 10;
+module_param(alert_storm_limit, uint, 0644);
+MODULE_PARM_DESC(alert_storm_limit, "Alerts per second before they are coalesced, 0 = never");
+
+static unsigned long blackbox_addr;
+module_param(blackbox_addr, ulong, 0444);
+MODULE_PARM_DESC(blackbox_addr, "Physical address of the persistent black box");
+static unsigned long blackbox_size;
+module_param(blackbox_size, ulong, 0444);
+MODULE_PARM_DESC(blackbox_size, "Size of the persistent black box, 0 = off");
+static bool blackbox_enable = true;
+module_param(blackbox_enable, bool, 0644);
+MODULE_PARM_DESC(blackbox_enable, "Record samples into the black box");
+
+/* default: a day of seconds, a month of minutes, a year of hours */
+static unsigned int tier_points[MCP9808_NR_TIERS] = { 86400, 43200, 8760 };
+module_param_array(tier_points, uint, NULL, 0444);
+MODULE_PARM_DESC(tier_points, "Points kept per sensor in the 1 s, 1 min and 1 h tiers");
+
+static dev_t mcp9808_dev;          /* first of MCP9808_NR_MINORS minors */
+static struct class *mcp9808_class;
+static DEFINE_IDA(mcp9808_ida);
+static struct cdev mcp9808_all_cdev;
+static struct mcp9808_latest *mcp9808_latest_page;     /* by minor */
+static struct mcp9808_data *mcp9808_devices[MCP9808_MAX_DEVICES]; /* by minor */
+static DEFINE_MUTEX(mcp9808_devices_lock);
+
+/* Persistent black box layout; records follow the header */
+struct mcp9808_bb_header {
+    u32 magic;
+    u32 nrecords;                   /* power of two */
+    u64 boot_base_ns;               /* CLOCK_BOOTTIME at record tick 0 */
+    s64 real_base_ns;               /* CLOCK_REALTIME at record tick 0 */
+};
+
+static struct mcp9808_bb_header *mcp9808_bb;
+static u64 *mcp9808_bb_records;     /* tick | raw << 32 | minor << 48 | 1 << 56 */
+static atomic64_t mcp9808_bb_head;
+static u32 mcp9808_bb_mask;         /* header copies in cached RAM */
+static u64 mcp9808_bb_base_ns;
+static struct mcp9808_blackbox_sample *mcp9808_bb_saved;  /* previous boot */
+static size_t mcp9808_bb_saved_len;
+static struct cdev mcp9808_bb_cdev;
+
+/* Sensors on one adapter, polled together */
+struct mcp9808_bus {
+    struct i2c_adapter  *adap;
+    struct list_head     node;          /* in mcp9808_buses */
+    struct mutex         lock;          /* protects everything below */
+    struct list_head     devices;
+    unsigned int         ndevices;
+    struct delayed_work  work;
+
+    /* transfer scratch, sized for ndevices when a sensor attaches */
+    struct mcp9808_data **due;
+    struct i2c_msg      *msgs;          /* write/read pair per sensor */
+    u8                  *bufs;          /* register + 2 data bytes per sensor */
+};
+
+static LIST_HEAD(mcp9808_buses);
+static DEFINE_MUTEX(mcp9808_buses_lock);
+
+enum { MCP9808_UPPER, MCP9808_LOWER, MCP9808_CRIT, MCP9808_NR_LIMITS };
+
+static const u8 mcp9808_limit_reg[MCP9808_NR_LIMITS] = {
+    [MCP9808_UPPER] = MCP9808_TUPPER_REG,
+    [MCP9808_LOWER] = MCP9808_TLOWER_REG,
+    [MCP9808_CRIT]  = MCP9808_TCRIT_REG,
+};
+
+struct mcp9808_stats {
+    unsigned long bus_reads;
+    unsigned long batched_reads;
+    unsigned long alerts;
+    unsigned long alert_storms;
+    unsigned long alerts_coalesced;
+    unsigned long sample_overruns;
+    unsigned long event_overruns;
+};
+
+/*
+ * Consolidated point as kept in a tier ring, 8 bytes: temperatures in
+ * register units (1/16 °C) and the lap of the ring it was stored in, so
+ * a cell left from an earlier lap reads back as empty without the gap
+ * ever being cleared.
+ */
+struct mcp9808_tier_cell {
+    s64 min:13;
+    s64 max:13;
+    s64 mean:13;
+    u64 count:15;                   /* saturating; 0 = no samples */
+    u64 lap:10;                     /* slot / npoints, modulo 1024 */
+};
+
+#define MCP9808_TIER_UNIT      625             /* 10⁻⁴ °C per cell unit */
+#define MCP9808_TIER_COUNT_MAX ((1 << 15) - 1)
+#define MCP9808_TIER_LAP_MASK  ((1 << 10) - 1)
+
+/* One retention tier: a ring of closed points and the open one */
+struct mcp9808_tier {
+    struct mcp9808_tier_cell *cells;    /* indexed by slot % npoints */
+    unsigned int              npoints;
+    u32                       slot;     /* interval number of the open point */
+    s64                       sum;      /* open point, exact across tiers */
+    u32                       count;
+    s32                       min;
+    s32                       max;
+};
+
+/* Holt estimator state; level in °C × 10⁴ and trend per second, Q16 */
+struct mcp9808_holt {
+    s64  level;
+    s64  trend;
+    s64  last_ns;
+    bool primed;
+    u16  warned;                    /* MCP9808_FLAG_* with a warning out */
+};
+
+struct mcp9808_data {
+    struct i2c_client *client;
+    struct kref        ref;         /* the bound device and each open file */
+    struct rw_semaphore remove_lock; /* held shared while using client or bus */
+    bool               dead;        /* removed; under remove_lock */
+    struct cdev       *cdev;
+    int                minor;
+    int                irq;
+    unsigned long      irq_flags;   /* trigger, when not from firmware */
+    u16                config;      /* cached configuration register */
+    s32                limit[MCP9808_NR_LIMITS];
+    s64                alert_ts;    /* hard IRQ timestamp of pending alert */
+
+    /* ALERT storm state; the window is only touched by the IRQ thread */
+    s64                 window_start;   /* rate limit window */
+    unsigned int        window_alerts;
+    bool                storm;          /* hard IRQ only counts alerts */
+    bool                irq_masked;     /* masked by the hard IRQ in a storm */
+    atomic_t            storm_alerts;   /* counted this period */
+    unsigned int        storm_budget;   /* alerts per period before masking */
+    unsigned int        storm_backoff_ms;
+    struct delayed_work storm_work;
+    bool                alert_stopped;  /* IRQ quiesced for teardown */
+    u32                horizon_ms;  /* forecast horizon */
+    struct mcp9808_holt holt;       /* protected by lock */
+
+    /* record pools, preallocated in probe; protected by lock */
+    spinlock_t             lock;
+    struct mcp9808_sample *samples;
+    u64                    sample_seq;  /* seq of the next sample */
+    struct mcp9808_event  *events;
+    u64                    event_head;  /* pool position of the next event */
+    u64                    event_seq;   /* seq of the next event, any queue */
+    struct rb_root         thresholds;  /* every file's, by (temp, file) */
+    struct mcp9808_tier    tiers[MCP9808_NR_TIERS];
+    struct mcp9808_stats   stats;
+
+    wait_queue_head_t  wait;
+
+    /* sampling schedule, shared with the rest of the bus */
+    struct mutex        sub_lock;       /* protects files */
+    struct list_head    files;
+    u64                 period_ns;      /* 0 when nobody subscribed */
+    struct mcp9808_bus *bus;
+    struct list_head    bus_node;       /* in bus->devices */
+    u64                 next_ns;        /* next poll, under bus->lock */
+};
+
+/* Per-open-file state */
+struct mcp9808_file {
+    struct mcp9808_data *d;
+    struct list_head     node;          /* in d->files */
+    u32                  mode;          /* MCP9808_MODE_* */
+    u64                  period_ns;     /* requested, 0 = no subscription */
+
+    /* read cursors, protected by d->lock */
+    u64                  sample_seq;    /* next sample not yet read */
+    u64                  next_due_ns;   /* decimation: next sample wanted */
+    u64                  event_head;    /* next pool event not yet read */
+    struct list_head     thresholds;    /* this file's, in d->thresholds */
+    unsigned int         nthresholds;
+    DECLARE_KFIFO(events, struct mcp9808_event, MCP9808_FILE_EVENTS);
+};
+
+/* Software threshold registered by one file */
+struct mcp9808_threshold {
+    struct rb_node       node;          /* in d->thresholds */
+    struct list_head     file_node;     /* in f->thresholds */
+    struct mcp9808_file *f;
+    s32                  temp;
+};
+
+/* Convert a 13-bit two's complement register value to °C × 10⁴ */
+static s32 mcp9808_raw_to_temp(u16 raw)
+{
+    return sign_extend32(raw & 0x1FFF, 12) * 625;    /* 1/16 °C = 625 */
+}
+
+/* Convert °C × 10⁴ to a limit register value (0.25°C steps) */
+static u16 mcp9808_temp_to_limit(s32 temp)
+{
+    int quarters;
+
+    temp = clamp(temp, MCP9808_TEMP_MIN, MCP9808_TEMP_MAX);
+    quarters = DIV_ROUND_CLOSEST(temp * 4, 10000);
+    return (quarters * 4) & 0x1FFC;
+}
+
+static u16 mcp9808_raw_flags(u16 raw)
+{
+    u16 flags = 0;
+
+    if (raw & 0x8000) flags |= MCP9808_FLAG_CRIT;
+    if (raw & 0x4000) flags |= MCP9808_FLAG_UPPER;
+    if (raw & 0x2000) flags |= MCP9808_FLAG_LOWER;
+    return flags;
+}
+
+/* Set resolution of the MCP9808 to 0.125°C */
+static int set_resolution(struct i2c_client *client)
+{
+    int ret = i2c_smbus_write_byte_data(client, MCP9808_RES_REG, MCP9808_RESOLUTION);
+    if (ret < 0)
+        dev_err(&client->dev, "Failed to set resolution\n");
+    else
+        dev_info(&client->dev, "Resolution set to 0.125°C\n");
+    return ret;
+}
+
+/* Read the raw temperature register in one combined transaction */
+static int read_temperature(struct i2c_client *client, u16 *raw)
+{
+    int ret = i2c_smbus_read_word_swapped(client, MCP9808_TEMP_REG);
+
+    if (ret < 0) {
+        dev_err(&client->dev, "Read temp failed\n");
+        return ret;
+    }
+
+    *raw = ret;
+    dev_dbg(&client->dev, "Raw temp: %04X\n", *raw);
+    return 0;
+}
+
+/*
+ * Mirror a sample into the shared latest-values page; s == NULL clears
+ * the entry.  Called with the owning device's lock held, so each entry
+ * has a single writer.
+ */
+static void mcp9808_set_latest(int minor, const struct mcp9808_sample *s)
+{
+    struct mcp9808_latest *e = &mcp9808_latest_page[minor];
+
+    WRITE_ONCE(e->seq, e->seq + 1);
+    smp_wmb();
+    e->timestamp_ns = s ? s->timestamp_ns : 0;
+    e->temp         = s ? s->temp : 0;
+    e->raw          = s ? s->raw : 0;
+    e->flags        = s ? s->flags : 0;
+    smp_wmb();
+    WRITE_ONCE(e->seq, e->seq + 1);
+}
+
+/* Append a sample to the persistent black box: one 8-byte store */
+static void mcp9808_bb_record(int minor, const struct mcp9808_sample *s)
+{
+    u64 idx, tick;
+
+    if (!mcp9808_bb || !READ_ONCE(blackbox_enable))
+        return;
+
+    /* boottime keeps counting through suspend, as the wall clock does */
+    idx  = atomic64_inc_return(&mcp9808_bb_head) - 1;
+    tick = (ktime_get_boottime_ns() - mcp9808_bb_base_ns) >> MCP9808_BB_TICK_SHIFT;
+    WRITE_ONCE(mcp9808_bb_records[idx & mcp9808_bb_mask],
+               (u32)tick | (u64)s->raw << 32 | (u64)minor << 48 | 1ULL << 56);
+}
+
+/* Publish an event into the event pool; called with d->lock held */
+static void mcp9808_push_event(struct mcp9808_data *d, u16 type,
+                               s64 ts, s32 temp, u16 flags, u32 count)
+{
+    struct mcp9808_event *ev =
+        &d->events[d->event_head++ & (MCP9808_EVENT_POOL - 1)];
+
+    ev->seq          = d->event_seq++;
+    ev->timestamp_ns = ts;
+    ev->temp         = temp;
+    ev->type         = type;
+    ev->flags        = flags;
+    ev->count        = count;
+    ev->reserved     = 0;
+}
+
+/* Milliseconds until the trend reaches limit: -1 if never, 0 if there */
+static s32 mcp9808_eta_ms(const struct mcp9808_holt *h, s32 limit)
+{
+    s64 gap = ((s64)limit << 16) - h->level;
+
+    if (gap <= 0)
+        return 0;
+    if (h->trend <= 0)
+        return -1;
+    return min_t(s64, div64_s64(gap * 1000, h->trend), S32_MAX);
+}
+
+/*
+ * Advance the Holt estimator with a new sample and fill in the forecast
+ * fields; raise an early warning when a limit comes within the horizon.
+ * Called with d->lock held.
+ */
+static void mcp9808_forecast(struct mcp9808_data *d, struct mcp9808_sample *s)
+{
+    struct mcp9808_holt *h = &d->holt;
+    s64 x = (s64)s->temp << 16, pred, level, slope;
+    u32 horizon = READ_ONCE(d->horizon_ms);
+    u16 warn = 0, flag;
+    s32 eta[2];
+    s64 dt_ns = s->timestamp_ns - h->last_ns, dt_ms;
+    int i;
+
+    /*
+     * Samples less than 1 ms after the last one fed, or older than it
+     * (published out of order), leave the estimator and last_ns alone.
+     */
+    if (!h->primed) {
+        h->level  = x;
+        h->trend  = 0;
+        h->primed = true;
+        h->last_ns = s->timestamp_ns;
+    } else if (dt_ns >= NSEC_PER_MSEC) {
+        dt_ms = min_t(s64, div_s64(dt_ns, NSEC_PER_MSEC),
+                      MCP9808_HORIZON_MAX_MS);
+        pred  = h->level + div_s64(h->trend * (s64)dt_ms, 1000);
+        pred  = clamp(pred, -MCP9808_HOLT_LEVEL_MAX, MCP9808_HOLT_LEVEL_MAX);
+        level = pred + ((MCP9808_HOLT_ALPHA * (x - pred)) >> 16);
+        slope = div_s64((level - h->level) * 1000, dt_ms);
+        slope = clamp(slope, -MCP9808_HOLT_TREND_MAX, MCP9808_HOLT_TREND_MAX);
+        h->trend += (MCP9808_HOLT_BETA * (slope - h->trend)) >> 16;
+        h->level  = level;
+        h->last_ns = s->timestamp_ns;
+    }
+
+    pred = (h->level + div_s64(h->trend * (s64)horizon, 1000)) >> 16;
+    s->forecast     = clamp_t(s64, pred, MCP9808_TEMP_MIN, MCP9808_TEMP_MAX);
+    s->upper_eta_ms = eta[0] = mcp9808_eta_ms(h, READ_ONCE(d->limit[MCP9808_UPPER]));
+    s->crit_eta_ms  = eta[1] = mcp9808_eta_ms(h, READ_ONCE(d->limit[MCP9808_CRIT]));
+    s->reserved     = 0;
+
+    /* edge-triggered: one warning per approach to each limit */
+    for (i = 0; i < 2; i++) {
+        flag = i ? MCP9808_FLAG_CRIT : MCP9808_FLAG_UPPER;
+        if (eta[i] > 0 && (u32)eta[i] <= horizon) {
+            warn |= flag;
+            if (!(h->warned & flag))
+                mcp9808_push_event(d, MCP9808_EVENT_FORECAST,
+                                   s->timestamp_ns, s->forecast, flag, 1);
+        }
+    }
+    h->warned = warn;
+}
+
+/*
+ * Queue a crossing event for every threshold passed on the way from prev
+ * to the new temperature, nearest first: one descent to the first
+ * threshold in range, then an in-order walk.  A threshold counts as
+ * crossed when the temperature reaches it going up or drops below it
+ * going down.  Called with d->lock held.
+ */
+static void mcp9808_cross(struct mcp9808_data *d, s32 prev,
+                          const struct mcp9808_sample *s)
+{
+    bool rising = s->temp > prev;
+    s32 lo = min(prev, s->temp), hi = max(prev, s->temp);
+    struct rb_node *n = d->thresholds.rb_node, *first = NULL;
+    struct mcp9808_threshold *t;
+    struct mcp9808_event ev;
+
+    if (lo == hi)
+        return;
+
+    /* rising: lowest above lo; falling: highest not above hi */
+    while (n) {
+        t = rb_entry(n, struct mcp9808_threshold, node);
+        if (rising ? t->temp > lo : t->temp <= hi) {
+            first = n;
+            n = rising ? n->rb_left : n->rb_right;
+        } else {
+            n = rising ? n->rb_right : n->rb_left;
+        }
+    }
+
+    for (n = first; n; n = rising ? rb_next(n) : rb_prev(n)) {
+        t = rb_entry(n, struct mcp9808_threshold, node);
+        if (rising ? t->temp > hi : t->temp <= lo)
+            break;
+        ev.seq          = d->event_seq++;
+        ev.timestamp_ns = s->timestamp_ns;
+        ev.temp         = t->temp;
+        ev.type         = rising ? MCP9808_EVENT_RISING : MCP9808_EVENT_FALLING;
+        ev.flags        = s->flags;
+        ev.count        = 1;
+        ev.reserved     = 0;
+        if (!kfifo_put(&t->f->events, ev))
+            d->stats.event_overruns++;
+    }
+}
+
+/* Store the open point of a tier into its ring cell */
+static void mcp9808_tier_store(struct mcp9808_tier *t)
+{
+    struct mcp9808_tier_cell *c;
+
+    if (!t->npoints)
+        return;
+    c = &t->cells[t->slot % t->npoints];
+    c->min   = t->min / MCP9808_TIER_UNIT;
+    c->max   = t->max / MCP9808_TIER_UNIT;
+    c->mean  = DIV_ROUND_CLOSEST((s32)div_s64(t->sum, t->count),
+                                 MCP9808_TIER_UNIT);
+    c->count = min_t(u32, t->count, MCP9808_TIER_COUNT_MAX);
+    c->lap   = (t->slot / t->npoints) & MCP9808_TIER_LAP_MASK;
+}
+
+/* Whether a ring cell holds the point of the given lap, not a stale one */
+static bool mcp9808_tier_cell_valid(const struct mcp9808_tier_cell *c, u32 lap)
+{
+    return c->count && c->lap == (lap & MCP9808_TIER_LAP_MASK);
+}
+
+/*
+ * Add a sample to the 1 s tier.  When that closes the open second, the
+ * closed point is folded into the minute tier in turn, and so on up.
+ * Called with d->lock held.
+ */
+static void mcp9808_tiers_add(struct mcp9808_data *d, u64 ts, s32 temp)
+{
+    struct mcp9808_tier *t, in = {
+        .sum = temp, .count = 1, .min = temp, .max = temp,
+    }, closed;
+    u32 sec = div_u64(ts, NSEC_PER_SEC), slot;
+    int i;
+
+    for (i = 0; i < MCP9808_NR_TIERS; i++) {
+        t = &d->tiers[i];
+        slot = sec / mcp9808_tier_s[i];
+        closed.count = 0;
+
+        /* concurrent publishers may be a little out of order */
+        /* skipped intervals need no clearing: their cells' lap is stale */
+        if (t->count && slot > t->slot) {
+            closed = *t;
+            t->count = 0;
+        }
+        if (!t->count) {
+            t->slot = slot;
+            t->sum  = 0;
+            t->min  = S32_MAX;
+            t->max  = S32_MIN;
+        }
+        t->sum   += in.sum;
+        t->count += in.count;
+        t->min    = min(t->min, in.min);
+        t->max    = max(t->max, in.max);
+        mcp9808_tier_store(t);
+
+        if (!closed.count)
+            break;
+        in  = closed;
+        sec = closed.slot * mcp9808_tier_s[i];
+    }
+}
+
+/* Publish a raw reading into the sample pool */
+static void mcp9808_publish(struct mcp9808_data *d, u16 raw, u64 ts,
+                            struct mcp9808_sample *s)
+{
+    s->timestamp_ns = ts;
+    s->temp  = mcp9808_raw_to_temp(raw);
+    s->raw   = raw;
+    s->flags = mcp9808_raw_flags(raw);
+
+    spin_lock(&d->lock);
+    d->stats.bus_reads++;
+    mcp9808_forecast(d, s);
+    if (d->sample_seq)
+        mcp9808_cross(d, d->samples[(d->sample_seq - 1) &
+                                    (MCP9808_SAMPLE_POOL - 1)].temp, s);
+    s->seq = d->sample_seq++;
+    d->samples[s->seq & (MCP9808_SAMPLE_POOL - 1)] = *s;
+    mcp9808_tiers_add(d, ts, s->temp);
+    mcp9808_set_latest(d->minor, s);
+    mcp9808_bb_record(d->minor, s);
+    spin_unlock(&d->lock);
+
+    wake_up_interruptible(&d->wait);
+}
+
+/* Read the sensor and publish the result into the sample pool */
+static int mcp9808_sample(struct mcp9808_data *d, struct mcp9808_sample *s)
+{
+    u16 raw;
+    int ret;
+
+    ret = read_temperature(d->client, &raw);
+    if (ret)
+        return ret;
+
+    mcp9808_publish(d, raw, ktime_get_ns(), s);
+    return 0;
+}
+
+/* Latest sample if it is younger than one conversion; d->lock held */
+static bool mcp9808_fresh_sample(struct mcp9808_data *d,
+                                 struct mcp9808_sample *s)
+{
+    const struct mcp9808_sample *last;
+
+    if (!d->sample_seq)
+        return false;
+    last = &d->samples[(d->sample_seq - 1) & (MCP9808_SAMPLE_POOL - 1)];
+    if (ktime_get_ns() - last->timestamp_ns >= MCP9808_CONV_NS)
+        return false;
+    *s = *last;
+    return true;
+}
+
+/*
+ * Skip records this file decimates away and return the next one it
+ * should receive, without consuming it; called with d->lock held.
+ */
+static struct mcp9808_sample *mcp9808_peek_sample(struct mcp9808_file *f)
+{
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_sample *s;
+
+    if (d->sample_seq - f->sample_seq > MCP9808_SAMPLE_POOL) {
+        /* reader was lapped: its records were recycled */
+        d->stats.sample_overruns += d->sample_seq - f->sample_seq -
+                                    MCP9808_SAMPLE_POOL;
+        f->sample_seq = d->sample_seq - MCP9808_SAMPLE_POOL;
+    }
+
+    for (; f->sample_seq != d->sample_seq; f->sample_seq++) {
+        s = &d->samples[f->sample_seq & (MCP9808_SAMPLE_POOL - 1)];
+        /* half a schedule tick of slack absorbs work queue jitter */
+        if (s->timestamp_ns + d->period_ns / 2 >= f->next_due_ns)
+            return s;
+    }
+    return NULL;
+}
+
+/* Consume the record returned by mcp9808_peek_sample(); d->lock held */
+static void mcp9808_consume_sample(struct mcp9808_file *f,
+                                   const struct mcp9808_sample *s)
+{
+    f->sample_seq++;
+    if (!f->period_ns)
+        return;
+    f->next_due_ns += f->period_ns;
+    if (f->next_due_ns + f->period_ns < s->timestamp_ns)
+        f->next_due_ns = s->timestamp_ns + f->period_ns;   /* resync after a gap */
+}
+
+static bool mcp9808_sample_ready(struct mcp9808_file *f)
+{
+    struct mcp9808_data *d = f->d;
+    bool ready;
+
+    spin_lock(&d->lock);
+    ready = mcp9808_peek_sample(f) != NULL;
+    spin_unlock(&d->lock);
+    return ready;
+}
+
+/* Number of sensors one i2c_transfer() may cover on this adapter */
+static unsigned int mcp9808_batch_limit(struct mcp9808_bus *bus)
+{
+    const struct i2c_adapter_quirks *q = bus->adap->quirks;
+
+    if (!i2c_check_functionality(bus->adap, I2C_FUNC_I2C))
+        return 1;
+    if (q && q->max_num_msgs)
+        return max(q->max_num_msgs / 2, 1);
+    return bus->ndevices;
+}
+
+/* Read n due sensors, batching write/read pairs into one transfer */
+static void mcp9808_read_due(struct mcp9808_bus *bus, unsigned int n)
+{
+    unsigned int limit = mcp9808_batch_limit(bus);
+    struct mcp9808_sample s;
+    struct mcp9808_data *d;
+    unsigned int i, j, chunk;
+    u64 ts;
+    int ret;
+
+    for (i = 0; i < n; i += chunk) {
+        chunk = min(n - i, limit);
+
+        if (chunk > 1) {
+            for (j = 0; j < chunk; j++) {
+                struct i2c_client *client = bus->due[i + j]->client;
+                u16 flags = client->flags & I2C_M_TEN;
+                u8 *buf = &bus->bufs[3 * j];
+
+                buf[0] = MCP9808_TEMP_REG;
+                bus->msgs[2 * j] = (struct i2c_msg) {
+                    .addr = client->addr, .flags = flags,
+                    .len = 1, .buf = buf,
+                };
+                bus->msgs[2 * j + 1] = (struct i2c_msg) {
+                    .addr = client->addr, .flags = flags | I2C_M_RD,
+                    .len = 2, .buf = buf + 1,
+                };
+            }
+
+            ret = i2c_transfer(bus->adap, bus->msgs, 2 * chunk);
+            if (ret == 2 * chunk) {
+                ts = ktime_get_ns();
+                for (j = 0; j < chunk; j++) {
+                    u8 *buf = &bus->bufs[3 * j];
+
+                    d = bus->due[i + j];
+                    mcp9808_publish(d, (buf[1] << 8) | buf[2], ts, &s);
+                    d->stats.batched_reads++;
+                }
+                continue;
+            }
+            /* one NACK aborts the whole transfer; read one by one */
+            dev_dbg(&bus->adap->dev, "Batched read failed (%d)\n", ret);
+        }
+
+        for (j = 0; j < chunk; j++)
+            mcp9808_sample(bus->due[i + j], &s);
+    }
+}
+
+/* Bus schedule: one tick reads every sensor that is due */
+static void mcp9808_bus_work(struct work_struct *work)
+{
+    struct mcp9808_bus *bus =
+        container_of(to_delayed_work(work), struct mcp9808_bus, work);
+    u64 now = ktime_get_ns(), next = U64_MAX, period;
+    struct mcp9808_data *d;
+    unsigned int n = 0;
+
+    mutex_lock(&bus->lock);
+    list_for_each_entry(d, &bus->devices, bus_node) {
+        period = READ_ONCE(d->period_ns);
+        if (!period)
+            continue;
+        /* a jiffy of slack lets sensors due close together share a tick */
+        if (d->next_ns <= now + TICK_NSEC) {
+            bus->due[n++] = d;
+            d->next_ns += period;
+            if (d->next_ns <= now)
+                d->next_ns = now + period;
+        }
+        next = min(next, d->next_ns);
+    }
+
+    mcp9808_read_due(bus, n);
+    if (next != U64_MAX)
+        schedule_delayed_work(&bus->work,
+                              nsecs_to_jiffies(next - min(next, now)));
+    mutex_unlock(&bus->lock);
+}
+
+/* Re-derive the device period from its fastest subscriber */
+static void mcp9808_update_schedule(struct mcp9808_data *d)
+{
+    struct mcp9808_bus *bus = d->bus;
+    struct mcp9808_file *f;
+    u64 period = 0, old;
+
+    mutex_lock(&d->sub_lock);
+    list_for_each_entry(f, &d->files, node)
+        if (f->period_ns && (!period || f->period_ns < period))
+            period = f->period_ns;
+    if (period)
+        period = max_t(u64, period, MCP9808_CONV_NS);
+
+    old = d->period_ns;
+    WRITE_ONCE(d->period_ns, period);
+    mutex_unlock(&d->sub_lock);
+
+    /* a slower or cancelled period takes effect on the next tick */
+    down_read(&d->remove_lock);
+    if (!d->dead && period && (!old || period < old)) {
+        dev_dbg(&d->client->dev, "Sampling period %llu ns\n", period);
+        mutex_lock(&bus->lock);
+        d->next_ns = ktime_get_ns();
+        mutex_unlock(&bus->lock);
+        mod_delayed_work(system_wq, &bus->work, 0);
+    }
+    up_read(&d->remove_lock);
+}
+
+/* Size the transfer scratch for n sensors; called with bus->lock held */
+static int mcp9808_bus_resize(struct mcp9808_bus *bus, unsigned int n)
+{
+    void *p;
+
+    p = krealloc_array(bus->due, n, sizeof(*bus->due), GFP_KERNEL);
+    if (!p)
+        return -ENOMEM;
+    bus->due = p;
+
+    p = krealloc_array(bus->msgs, 2 * n, sizeof(*bus->msgs), GFP_KERNEL);
+    if (!p)
+        return -ENOMEM;
+    bus->msgs = p;
+
+    p = krealloc_array(bus->bufs, 3 * n, sizeof(*bus->bufs), GFP_KERNEL);
+    if (!p)
+        return -ENOMEM;
+    bus->bufs = p;
+    return 0;
+}
+
+/* Drop an empty polling group; called with mcp9808_buses_lock held */
+static void mcp9808_bus_free(struct mcp9808_bus *bus)
+{
+    list_del(&bus->node);
+    cancel_delayed_work_sync(&bus->work);
+    kfree(bus->due);
+    kfree(bus->msgs);
+    kfree(bus->bufs);
+    kfree(bus);
+}
+
+/* Join the polling group of this sensor's adapter, creating it if needed */
+static int mcp9808_bus_attach(struct mcp9808_data *d)
+{
+    struct i2c_adapter *adap = d->client->adapter;
+    struct mcp9808_bus *bus;
+    unsigned int n;
+    int ret = -ENOMEM;
+
+    mutex_lock(&mcp9808_buses_lock);
+    list_for_each_entry(bus, &mcp9808_buses, node)
+        if (bus->adap == adap)
+            goto found;
+
+    bus = kzalloc(sizeof(*bus), GFP_KERNEL);
+    if (!bus)
+        goto out;
+    bus->adap = adap;
+    mutex_init(&bus->lock);
+    INIT_LIST_HEAD(&bus->devices);
+    INIT_DELAYED_WORK(&bus->work, mcp9808_bus_work);
+    list_add(&bus->node, &mcp9808_buses);
+
+found:
+    mutex_lock(&bus->lock);
+    n = bus->ndevices + 1;
+    ret = mcp9808_bus_resize(bus, n);
+    if (ret) {
+        mutex_unlock(&bus->lock);
+        goto out_empty;
+    }
+    list_add_tail(&d->bus_node, &bus->devices);
+    bus->ndevices = n;
+    d->bus = bus;
+    mutex_unlock(&bus->lock);
+
+out_empty:
+    if (ret && !bus->ndevices)
+        mcp9808_bus_free(bus);
+out:
+    mutex_unlock(&mcp9808_buses_lock);
+    return ret;
+}
+
+static void mcp9808_bus_detach(struct mcp9808_data *d)
+{
+    struct mcp9808_bus *bus = d->bus;
+
+    mutex_lock(&mcp9808_buses_lock);
+    mutex_lock(&bus->lock);
+    list_del(&d->bus_node);
+    bus->ndevices--;
+    mutex_unlock(&bus->lock);
+
+    if (!bus->ndevices)
+        mcp9808_bus_free(bus);
+    mutex_unlock(&mcp9808_buses_lock);
+}
+
+/*
+ * Take the oldest unread event for this file, from the shared pool or
+ * its own threshold queue, whichever has the lower seq; called with
+ * d->lock held.
+ */
+static bool mcp9808_pop_event(struct mcp9808_file *f, struct mcp9808_event *ev)
+{
+    struct mcp9808_data *d = f->d;
+    const struct mcp9808_event *shared = NULL;
+    struct mcp9808_event own;
+    bool has_own;
+
+    if (d->event_head - f->event_head > MCP9808_EVENT_POOL) {
+        /* reader was lapped: its records were recycled */
+        d->stats.event_overruns += d->event_head - f->event_head -
+                                   MCP9808_EVENT_POOL;
+        f->event_head = d->event_head - MCP9808_EVENT_POOL;
+    }
+    if (f->event_head != d->event_head)
+        shared = &d->events[f->event_head & (MCP9808_EVENT_POOL - 1)];
+
+    has_own = kfifo_peek(&f->events, &own);
+    if (has_own && (!shared || own.seq < shared->seq)) {
+        kfifo_skip(&f->events);
+        *ev = own;
+        return true;
+    }
+    if (!shared)
+        return false;
+    *ev = *shared;
+    f->event_head++;
+    return true;
+}
+
+/* Find this file's threshold at temp; called with d->lock held */
+static struct mcp9808_threshold *mcp9808_find_threshold(struct mcp9808_file *f,
+                                                        s32 temp,
+                                                        struct rb_node ***link,
+                                                        struct rb_node **parent)
+{
+    struct rb_node **p = &f->d->thresholds.rb_node;
+    struct mcp9808_threshold *t;
+
+    *parent = NULL;
+    while (*p) {
+        *parent = *p;
+        t = rb_entry(*p, struct mcp9808_threshold, node);
+        if (temp != t->temp)
+            p = temp < t->temp ? &(*p)->rb_left : &(*p)->rb_right;
+        else if (f != t->f)
+            p = (unsigned long)f < (unsigned long)t->f ?
+                &(*p)->rb_left : &(*p)->rb_right;
+        else
+            return t;
+    }
+    *link = p;
+    return NULL;
+}
+
+static int mcp9808_add_threshold(struct mcp9808_file *f, s32 temp)
+{
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_threshold *t;
+    struct rb_node **link, *parent;
+    int ret = 0;
+
+    t = kmalloc(sizeof(*t), GFP_KERNEL);
+    if (!t)
+        return -ENOMEM;
+    t->f    = f;
+    t->temp = temp;
+
+    spin_lock(&d->lock);
+    if (f->nthresholds >= MCP9808_MAX_THRESHOLDS) {
+        ret = -ENOSPC;
+    } else if (mcp9808_find_threshold(f, temp, &link, &parent)) {
+        ret = -EEXIST;
+    } else {
+        rb_link_node(&t->node, parent, link);
+        rb_insert_color(&t->node, &d->thresholds);
+        list_add(&t->file_node, &f->thresholds);
+        f->nthresholds++;
+    }
+    spin_unlock(&d->lock);
+
+    if (ret)
+        kfree(t);
+    return ret;
+}
+
+/* Unlink a threshold from both indexes; called with d->lock held */
+static void mcp9808_unlink_threshold(struct mcp9808_threshold *t)
+{
+    rb_erase(&t->node, &t->f->d->thresholds);
+    list_del(&t->file_node);
+    t->f->nthresholds--;
+}
+
+static int mcp9808_del_threshold(struct mcp9808_file *f, s32 temp)
+{
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_threshold *t;
+    struct rb_node **link, *parent;
+
+    spin_lock(&d->lock);
+    t = mcp9808_find_threshold(f, temp, &link, &parent);
+    if (t)
+        mcp9808_unlink_threshold(t);
+    spin_unlock(&d->lock);
+
+    if (!t)
+        return -ENOENT;
+    kfree(t);
+    return 0;
+}
+
+/* ALERT hard IRQ: only timestamp, the bus work happens in the thread */
+static irqreturn_t mcp9808_alert_hardirq(int irq, void *dev_id)
+{
+    struct mcp9808_data *d = dev_id;
+
+    if (READ_ONCE(d->storm)) {
+        /* coalesced into the next summary; mask a line still too busy */
+        if (atomic_inc_return(&d->storm_alerts) >= d->storm_budget &&
+            !READ_ONCE(d->irq_masked)) {
+            /* publish only once the disable it stands for is done */
+            disable_irq_nosync(irq);
+            WRITE_ONCE(d->irq_masked, true);
+        }
+        return IRQ_HANDLED;
+    }
+
+    d->alert_ts = ktime_get_ns();
+    return IRQ_WAKE_THREAD;
+}
+
+/* Set the alert budget of a storm period of backoff_ms */
+static void mcp9808_storm_period(struct mcp9808_data *d, unsigned int backoff_ms)
+{
+    unsigned int limit = READ_ONCE(alert_storm_limit);
+
+    d->storm_backoff_ms = backoff_ms;
+    d->storm_budget = max_t(unsigned int, 1, limit * backoff_ms / MSEC_PER_SEC);
+}
+
+/*
+ * Count an alert against alert_storm_limit per second; on overflow start
+ * a storm: from here on the hard IRQ handler only counts.  Called from
+ * the IRQ thread.
+ */
+static bool mcp9808_storm_check(struct mcp9808_data *d)
+{
+    unsigned int limit = READ_ONCE(alert_storm_limit);
+
+    if (!limit)
+        return false;
+    if (d->alert_ts - d->window_start >= NSEC_PER_SEC) {
+        d->window_start  = d->alert_ts;
+        d->window_alerts = 0;
+    }
+    if (++d->window_alerts <= limit)
+        return false;
+
+    d->window_alerts = 0;
+    atomic_set(&d->storm_alerts, 0);
+    mcp9808_storm_period(d, MCP9808_STORM_BACKOFF_MS);
+    WRITE_ONCE(d->storm, true);
+    return true;
+}
+
+static irqreturn_t mcp9808_alert_thread(int irq, void *dev_id)
+{
+    struct mcp9808_data *d = dev_id;
+    struct i2c_client *client = d->client;
+    struct mcp9808_sample s;
+    bool storm;
+    u16 config;
+
+    if (mcp9808_sample(d, &s))
+        return IRQ_HANDLED;
+
+    /* a storm rides out in comparator mode, which does not latch */
+    storm  = mcp9808_storm_check(d);
+    config = storm ? (d->config & ~MCP9808_CFG_ALERT_MOD) | MCP9808_CFG_HYST_6C
+                   : d->config;
+
+    /* interrupt mode latches ALERT until software clears it */
+    if (i2c_smbus_write_word_swapped(client, MCP9808_CONFIG_REG,
+                                     config | MCP9808_CFG_INT_CLEAR) < 0)
+        dev_err(&client->dev, "Failed to clear alert\n");
+
+    spin_lock(&d->lock);
+    d->stats.alerts++;
+    if (storm)
+        d->stats.alert_storms++;
+    mcp9808_push_event(d, MCP9808_EVENT_ALERT, d->alert_ts, s.temp, s.flags,
+                       1);
+    spin_unlock(&d->lock);
+
+    wake_up_interruptible(&d->wait);
+    if (storm)
+        schedule_delayed_work(&d->storm_work,
+                              msecs_to_jiffies(d->storm_backoff_ms));
+    return IRQ_HANDLED;
+}
+
+/*
+ * End of a storm period: report the alerts counted meanwhile in one
+ * MCP9808_EVENT_STORM, then either restore interrupt mode or, if alerts
+ * still came faster than the limit, keep coalescing for twice as long.
+ */
+static void mcp9808_storm_work(struct work_struct *work)
+{
+    struct mcp9808_data *d =
+        container_of(to_delayed_work(work), struct mcp9808_data, storm_work);
+    struct i2c_client *client = d->client;
+    struct mcp9808_sample s = {};
+    unsigned int count;
+    bool again;
+
+    count = atomic_xchg(&d->storm_alerts, 0);
+    again = READ_ONCE(alert_storm_limit) && count >= d->storm_budget;
+
+    if (mcp9808_sample(d, &s)) {
+        dev_warn(&client->dev, "Failed to read storm summary\n");
+        s.temp = MCP9808_NO_VALUE;          /* not to be taken for 0 °C */
+    }
+
+    if (!again) {
+        if (i2c_smbus_write_word_swapped(client, MCP9808_CONFIG_REG,
+                                         d->config | MCP9808_CFG_INT_CLEAR) < 0)
+            dev_err(&client->dev, "Failed to restore alert mode\n");
+        WRITE_ONCE(d->storm, false);
+    }
+    /*
+     * Wait out a hard IRQ that may be masking the line right now, so the
+     * flag below matches the disable depth and enable_irq() stays balanced.
+     */
+    synchronize_irq(d->irq);
+    if (READ_ONCE(d->irq_masked)) {
+        WRITE_ONCE(d->irq_masked, false);
+        enable_irq(d->irq);
+    }
+
+    spin_lock(&d->lock);
+    d->stats.alerts_coalesced += count;
+    mcp9808_push_event(d, MCP9808_EVENT_STORM, ktime_get_ns(), s.temp,
+                       s.flags, count);
+    spin_unlock(&d->lock);
+    wake_up_interruptible(&d->wait);
+
+    if (again) {
+        mcp9808_storm_period(d, min_t(unsigned int, 2 * d->storm_backoff_ms,
+                                      MCP9808_STORM_BACKOFF_MAX_MS));
+        schedule_delayed_work(&d->storm_work,
+                              msecs_to_jiffies(d->storm_backoff_ms));
+    }
+}
+
+/*
+ * Quiesce ALERT before the IRQ is freed: once the line is disabled the
+ * thread cannot queue storm work, and cancelling it waits for a run that
+ * might otherwise enable the freed line.
+ */
+static void mcp9808_stop_alert(void *data)
+{
+    struct mcp9808_data *d = data;
+
+    if (d->alert_stopped)
+        return;
+    d->alert_stopped = true;
+    disable_irq(d->irq);
+    cancel_delayed_work_sync(&d->storm_work);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+static unsigned long mcp9808_alert_param_used;  /* bit 0: alert_chip taken */
+
+static void mcp9808_put_gpio_device(void *gdev)
+{
+    gpio_device_put(gdev);
+}
+
+static void mcp9808_release_alert_param(void *unused)
+{
+    clear_bit(0, &mcp9808_alert_param_used);
+}
+
+/* IRQ of the alert_chip/alert_line module parameters, 0 if not ours */
+static int mcp9808_alert_param_irq(struct device *dev)
+{
+    struct gpio_device *gdev;
+    struct gpio_desc *desc;
+    int ret;
+
+    gdev = gpio_device_find_by_label(alert_chip);
+    if (!gdev)
+        return -EPROBE_DEFER;
+    ret = devm_add_action_or_reset(dev, mcp9808_put_gpio_device, gdev);
+    if (ret)
+        return ret;
+
+    /* the IRQ is not shared: later sensors are polled only */
+    if (test_and_set_bit(0, &mcp9808_alert_param_used)) {
+        dev_info(dev, "alert_chip already serves another sensor\n");
+        return 0;
+    }
+    ret = devm_add_action_or_reset(dev, mcp9808_release_alert_param, NULL);
+    if (ret)
+        return ret;
+
+    desc = gpio_device_get_desc(gdev, alert_line);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return gpiod_to_irq(desc);
+}
+#else
+static int mcp9808_alert_param_irq(struct device *dev)
+{
+    dev_warn(dev, "alert_chip needs Linux 6.7 or later, ignored\n");
+    return 0;
+}
+#endif
+
+/* Find the ALERT IRQ: firmware IRQ, 'alert-gpios', or the module params */
+static int mcp9808_find_alert_irq(struct mcp9808_data *d)
+{
+    struct device *dev = &d->client->dev;
+    struct gpio_desc *desc;
+
+    if (d->client->irq > 0)
+        return d->client->irq;
+
+    /* ALERT is open-drain, active low: assertion is a falling edge */
+    d->irq_flags = IRQF_TRIGGER_FALLING;
+
+    desc = devm_gpiod_get_optional(dev, "alert", GPIOD_IN);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    if (desc)
+        return gpiod_to_irq(desc);
+
+    if (!alert_chip)
+        return 0;
+    return mcp9808_alert_param_irq(dev);
+}
+
+/* Enable ALERT in interrupt mode and hook up the threaded handler */
+/* Stop and free ALERT ahead of devm, before the minor is released */
+static void mcp9808_free_alert(struct mcp9808_data *d)
+{
+    if (d->irq <= 0)
+        return;
+    mcp9808_stop_alert(d);
+    devm_free_irq(&d->client->dev, d->irq, d);
+}
+
+static int mcp9808_setup_alert(struct mcp9808_data *d)
+{
+    struct i2c_client *client = d->client;
+    int ret;
+
+    d->config = MCP9808_CFG_ALERT_CNT | MCP9808_CFG_ALERT_MOD;
+    ret = i2c_smbus_write_word_swapped(client, MCP9808_CONFIG_REG, d->config);
+    if (ret < 0) {
+        dev_err(&client->dev, "Failed to enable alert output\n");
+        return ret;
+    }
+
+    INIT_DELAYED_WORK(&d->storm_work, mcp9808_storm_work);
+    ret = devm_request_threaded_irq(&client->dev, d->irq,
+                                    mcp9808_alert_hardirq,
+                                    mcp9808_alert_thread,
+                                    IRQF_ONESHOT | d->irq_flags,
+                                    DEVICE_NAME, d);
+    if (ret) {
+        dev_err(&client->dev, "Failed to request IRQ %d\n", d->irq);
+        return ret;
+    }
+
+    /* registered after the IRQ so that it runs before it is freed */
+    return devm_add_action_or_reset(&client->dev, mcp9808_stop_alert, d);
+}
+
+/*
+ * read_iter() in binary mode: whole sample records, blocking unless
+ * O_NONBLOCK.  Going through an iov_iter lets copy_splice_read() fill
+ * pipe pages directly, so splice() moves samples to a file or socket
+ * without a round trip through userspace buffers.
+ */
+static ssize_t mcp9808_read_binary(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct file *file = iocb->ki_filp;
+    struct mcp9808_file *f = file->private_data;
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_sample batch[MCP9808_READ_BATCH], *s;
+    u64 due[MCP9808_READ_BATCH];    /* f->next_due_ns before each record */
+    size_t n = 0, len, done;
+    int i, ret;
+
+    if (iov_iter_count(to) < sizeof(*s))
+        return -EINVAL;
+
+    for (;;) {
+        do {
+            spin_lock(&d->lock);
+            for (i = 0; i < MCP9808_READ_BATCH &&
+                        (i + 1) * sizeof(*s) <= iov_iter_count(to); i++) {
+                s = mcp9808_peek_sample(f);
+                if (!s)
+                    break;
+                batch[i] = *s;
+                due[i] = f->next_due_ns;
+                mcp9808_consume_sample(f, s);
+            }
+            spin_unlock(&d->lock);
+
+            len = i * sizeof(*s);
+            done = copy_to_iter(batch, len, to);
+            if (done != len) {
+                /* hand the records not copied whole back to the file */
+                i = done / sizeof(*s);
+                spin_lock(&d->lock);
+                f->sample_seq  = batch[i].seq;
+                f->next_due_ns = due[i];
+                spin_unlock(&d->lock);
+                n += i * sizeof(*s);
+                return n ? n : -EFAULT;
+            }
+            n += len;
+        } while (i == MCP9808_READ_BATCH);
+
+        if (n)
+            return n;
+        if (READ_ONCE(d->dead))
+            return -ENODEV;
+        if ((file->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT))
+            return -EAGAIN;
+
+        ret = wait_event_interruptible(d->wait, mcp9808_sample_ready(f) ||
+                                                READ_ONCE(d->dead));
+        if (ret)
+            return ret;
+    }
+}
+
+/* char dev read_iter() */
+static ssize_t mcp9808_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct mcp9808_file *f = iocb->ki_filp->private_data;
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_sample s;
+    char tmp[32];
+    bool fresh;
+    size_t len;
+    int ret;
+
+    if (READ_ONCE(f->mode) == MCP9808_MODE_BINARY)
+        return mcp9808_read_binary(iocb, to);
+
+    if (iocb->ki_pos)
+        return 0;
+
+    /* a read within one conversion time would return the same value */
+    spin_lock(&d->lock);
+    fresh = mcp9808_fresh_sample(d, &s);
+    spin_unlock(&d->lock);
+
+    if (!fresh) {
+        down_read(&d->remove_lock);
+        ret = d->dead ? -ENODEV : mcp9808_sample(d, &s);
+        up_read(&d->remove_lock);
+        if (ret)
+            return ret;
+    }
+
+    len = snprintf(tmp, sizeof(tmp), "%s%d.%04d\n", s.temp < 0 ? "-" : "",
+                   abs(s.temp)/10000, abs(s.temp)%10000);
+    len = min(len, iov_iter_count(to));
+
+    if (copy_to_iter(tmp, len, to) != len)
+        return -EFAULT;
+
+    iocb->ki_pos += len;
+    return len;
+}
+
+static __poll_t mcp9808_poll(struct file *file, poll_table *wait)
+{
+    struct mcp9808_file *f = file->private_data;
+    struct mcp9808_data *d = f->d;
+    __poll_t mask = 0;
+
+    poll_wait(file, &d->wait, wait);
+
+    spin_lock(&d->lock);
+    if (f->event_head != d->event_head || !kfifo_is_empty(&f->events))
+        mask |= EPOLLPRI;
+    if (f->mode == MCP9808_MODE_TEXT || mcp9808_peek_sample(f))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    spin_unlock(&d->lock);
+    if (READ_ONCE(d->dead))
+        mask |= EPOLLHUP;
+    return mask;
+}
+
+static long mcp9808_ioctl(struct file *file, unsigned int cmd,
+                          unsigned long arg)
+{
+    struct mcp9808_file *f = file->private_data;
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_event ev;
+    bool found;
+    s32 temp;
+    u32 val;
+
+    if (READ_ONCE(d->dead))
+        return -ENODEV;
+
+    switch (cmd) {
+    case MCP9808_IOC_GET_EVENT:
+        spin_lock(&d->lock);
+        found = mcp9808_pop_event(f, &ev);
+        spin_unlock(&d->lock);
+        if (!found)
+            return -EAGAIN;
+        if (copy_to_user((void __user *)arg, &ev, sizeof(ev)))
+            return -EFAULT;
+        return 0;
+    case MCP9808_IOC_SET_MODE:
+        if (get_user(val, (u32 __user *)arg))
+            return -EFAULT;
+        if (val != MCP9808_MODE_TEXT && val != MCP9808_MODE_BINARY)
+            return -EINVAL;
+        WRITE_ONCE(f->mode, val);
+        return 0;
+    case MCP9808_IOC_SET_RATE:
+        if (get_user(val, (u32 __user *)arg))
+            return -EFAULT;
+        spin_lock(&d->lock);
+        f->period_ns   = val ? div_u64(1000ULL * NSEC_PER_SEC, val) : 0;
+        f->sample_seq  = d->sample_seq;
+        f->next_due_ns = 0;
+        spin_unlock(&d->lock);
+        mcp9808_update_schedule(d);
+        return 0;
+    case MCP9808_IOC_ADD_THRESHOLD:
+        if (get_user(temp, (s32 __user *)arg))
+            return -EFAULT;
+        return mcp9808_add_threshold(f, temp);
+    case MCP9808_IOC_DEL_THRESHOLD:
+        if (get_user(temp, (s32 __user *)arg))
+            return -EFAULT;
+        return mcp9808_del_threshold(f, temp);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* Last reference gone: the device is unbound and no file is open */
+static void mcp9808_free_data(struct kref *ref)
+{
+    struct mcp9808_data *d = container_of(ref, struct mcp9808_data, ref);
+
+    kvfree(d->tiers[0].cells);
+    kfree(d->samples);
+    kfree(d->events);
+    kfree(d);
+}
+
+/* open() */
+static int mcp9808_open(struct inode *inode, struct file *file)
+{
+    struct mcp9808_data *d;
+    struct mcp9808_file *f;
+
+    f = kzalloc(sizeof(*f), GFP_KERNEL);
+    if (!f)
+        return -ENOMEM;
+
+    /* the file keeps d alive past remove() */
+    mutex_lock(&mcp9808_devices_lock);
+    d = mcp9808_devices[iminor(inode)];
+    if (d) {
+        kref_get(&d->ref);
+        dev_info(&d->client->dev, "Device opened\n");
+    }
+    mutex_unlock(&mcp9808_devices_lock);
+    if (!d) {
+        kfree(f);
+        return -ENODEV;
+    }
+
+    f->d = d;
+    INIT_LIST_HEAD(&f->thresholds);
+    INIT_KFIFO(f->events);
+    spin_lock(&d->lock);
+    f->sample_seq = d->sample_seq;
+    f->event_head = d->event_head;
+    spin_unlock(&d->lock);
+
+    mutex_lock(&d->sub_lock);
+    list_add(&f->node, &d->files);
+    mutex_unlock(&d->sub_lock);
+
+    file->private_data = f;
+    return 0;
+}
+
+/* release() */
+static int mcp9808_release(struct inode *inode, struct file *file)
+{
+    struct mcp9808_file *f = file->private_data;
+    struct mcp9808_data *d = f->d;
+    struct mcp9808_threshold *t, *tmp;
+    LIST_HEAD(dead);
+
+    mutex_lock(&d->sub_lock);
+    list_del(&f->node);
+    mutex_unlock(&d->sub_lock);
+
+    spin_lock(&d->lock);
+    list_for_each_entry_safe(t, tmp, &f->thresholds, file_node) {
+        mcp9808_unlink_threshold(t);
+        list_add(&t->file_node, &dead);
+    }
+    spin_unlock(&d->lock);
+    list_for_each_entry_safe(t, tmp, &dead, file_node)
+        kfree(t);
+
+    if (f->period_ns)
+        mcp9808_update_schedule(d);
+    kfree(f);
+    kref_put(&d->ref, mcp9808_free_data);
+    return 0;
+}
+
+static const struct file_operations mcp9808_fops = {
+    .owner          = THIS_MODULE,
+    .open           = mcp9808_open,
+    .release        = mcp9808_release,
+    .read_iter      = mcp9808_read_iter,
+    .splice_read    = copy_splice_read,
+    .poll           = mcp9808_poll,
+    .unlocked_ioctl = mcp9808_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+};
+
+/* /dev/mcp9808-all: read-only mapping of the latest-values page */
+static int mcp9808_all_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_pfn_range(vma, vma->vm_start,
+                           virt_to_phys(mcp9808_latest_page) >> PAGE_SHIFT,
+                           PAGE_SIZE, vma->vm_page_prot);
+}
+
+/* One point of a sensor's history */
+struct mcp9808_point {
+    s64 ts;
+    s32 temp;
+};
+
+/* Oldest interval a tier still holds */
+static u32 mcp9808_tier_oldest(const struct mcp9808_tier *t)
+{
+    return t->slot >= t->npoints ? t->slot - t->npoints + 1 : 0;
+}
+
+/* Largest tier, in points: what a history series may take from one */
+static unsigned int mcp9808_tier_max_points(void)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < MCP9808_NR_TIERS; i++)
+        n = max(n, tier_points[i]);
+    return n;
+}
+
+/*
+ * Fill p with up to cap interval means of the finest tier reaching back
+ * to start, from start to one interval past end and stopping before the
+ * first sample still in the pool; each mean is placed at the middle of
+ * its interval.  The ring is walked in chunks with d->lock dropped in
+ * between, so a long range does not hold off publishers.
  */
+static unsigned int mcp9808_tier_series(struct mcp9808_data *d, s64 start,
+                                        s64 end, s64 before,
+                                        struct mcp9808_point *p,
+                                        unsigned int cap)
+{
+    const struct mcp9808_tier *t;
+    const struct mcp9808_tier_cell *c;
+    unsigned int n = 0, chunk;
+    u32 slot, last, lim, idx, lap;
+    int i, tier = -1;
+    u64 ns;
+    s64 ts;
 
-#include <linux/module.h>
-#include <linux/kernel.h>
-#include <linux/i2c.h>
-#include <linux/of.h>
-#include <linux/of_device.h>
-#include <linux/cdev.h>
-#include <linux/fs.h>
-#include <linux/uaccess.h>
-#include <linux/device.h>
+    if (end <= 0)
+        return 0;
 
-#define MCP9808_TEMP_REG     0x05    /* Temperature register */
-#define MCP9808_RES_REG      0x08    /* Resolution register */
-#define MCP9808_RESOLUTION   0x02    /* Set resolution to 0.125°C */
-#define DEVICE_NAME          "mcp9808"
+    spin_lock(&d->lock);
+    for (i = 0; i < MCP9808_NR_TIERS; i++) {
+        t = &d->tiers[i];
+        if (!t->npoints || !t->count)
+            continue;
+        tier = i;
+        ns = (u64)mcp9808_tier_s[i] * NSEC_PER_SEC;
+        if ((s64)(mcp9808_tier_oldest(t) * ns) <= start)
+            break;
+    }
+    if (tier < 0)
+        goto out;
 
-static dev_t mcp9808_dev;
-static struct class *mcp9808_class;
+    t    = &d->tiers[tier];
+    ns   = (u64)mcp9808_tier_s[tier] * NSEC_PER_SEC;
+    slot = start > 0 ? min_t(u64, div64_u64(start, ns), U32_MAX) : 0;
+    last = min_t(u64, div64_u64(end, ns) + 1, U32_MAX);
+    for (;;) {
+        /* the ring may have moved on while the lock was dropped */
+        slot = max(slot, mcp9808_tier_oldest(t));
+        lim  = min(last, t->slot);
+        if (slot > lim)
+            break;
+        lap = slot / t->npoints;
+        idx = slot - lap * t->npoints;
+        for (chunk = 0; chunk < MCP9808_TIER_CHUNK && slot <= lim;
+             chunk++, slot++) {
+            ts = slot * ns + ns / 2;
+            if (ts >= before || n == cap)
+                goto out;
+            c = &t->cells[idx];
+            if (mcp9808_tier_cell_valid(c, lap)) {
+                p[n].ts   = ts;
+                p[n].temp = c->mean * MCP9808_TIER_UNIT;
+                n++;
+            }
+            if (++idx == t->npoints) {
+                idx = 0;
+                lap++;
+            }
+        }
+        spin_unlock(&d->lock);
+        cond_resched();
+        spin_lock(&d->lock);
+    }
+out:
+    spin_unlock(&d->lock);
+    return n;
+}
 
-struct mcp9808_data {
-    struct i2c_client *client;
-    struct cdev        cdev;
-};
+/*
+ * Copy the history of a sensor between start and end into p, oldest
+ * first: up to cap tier means for the time before the sample pool,
+ * then the pool.  p must hold MCP9808_SAMPLE_POOL + cap entries.
+ */
+static unsigned int mcp9808_history_series(struct mcp9808_data *d, s64 start,
+                                           s64 end, struct mcp9808_point *p,
+                                           unsigned int cap)
+{
+    const struct mcp9808_sample *s;
+    unsigned int n = 0;
+    s64 oldest = S64_MAX;
+    u64 seq;
 
-/* Set resolution of the MCP9808 to 0.125°C */
-static int set_resolution(struct i2c_client *client)
+    spin_lock(&d->lock);
+    seq = d->sample_seq > MCP9808_SAMPLE_POOL ?
+          d->sample_seq - MCP9808_SAMPLE_POOL : 0;
+    if (seq != d->sample_seq)
+        oldest = d->samples[seq & (MCP9808_SAMPLE_POOL - 1)].timestamp_ns;
+    spin_unlock(&d->lock);
+
+    if (start < oldest)
+        n = mcp9808_tier_series(d, start, end, oldest, p, cap);
+
+    /* the pool only moves forward, so it still follows the tier means */
+    spin_lock(&d->lock);
+    seq = d->sample_seq > MCP9808_SAMPLE_POOL ?
+          d->sample_seq - MCP9808_SAMPLE_POOL : 0;
+    for (; seq != d->sample_seq; seq++, n++) {
+        s = &d->samples[seq & (MCP9808_SAMPLE_POOL - 1)];
+        p[n].ts   = s->timestamp_ns;
+        p[n].temp = s->temp;
+    }
+    spin_unlock(&d->lock);
+    return n;
+}
+
+/*
+ * Resample a series onto start + k * step for k < npoints.  Grid points
+ * outside the series get MCP9808_NO_VALUE; inside, the nearest sample or
+ * the linear interpolation between the two around the point.
+ */
+static void mcp9808_resample(const struct mcp9808_point *p, unsigned int n,
+                             const struct mcp9808_history_query *q, s32 *out)
 {
-    int ret = i2c_smbus_write_byte_data(client, MCP9808_RES_REG, MCP9808_RESOLUTION);
-    if (ret < 0)
-        dev_err(&client->dev, "Failed to set resolution\n");
-    else
-        dev_info(&client->dev, "Resolution set to 0.125°C\n");
-    return ret;
+    unsigned int i = 0, k;
+    s64 t, off, dt;
+
+    for (k = 0; k < q->npoints; k++) {
+        t = q->start_ns + (s64)k * q->step_ns;
+        if (!n || t < p[0].ts || t > p[n - 1].ts) {
+            out[k] = MCP9808_NO_VALUE;
+            continue;
+        }
+        while (i + 1 < n && p[i + 1].ts <= t)
+            i++;
+        if (i + 1 == n || p[i].ts == t) {
+            out[k] = p[i].temp;
+            continue;
+        }
+
+        off = t - p[i].ts;
+        dt  = p[i + 1].ts - p[i].ts;
+        if (q->mode == MCP9808_RESAMPLE_NEAREST) {
+            out[k] = off * 2 <= dt ? p[i].temp : p[i + 1].temp;
+            continue;
+        }
+        /* keep the product within 64 bits across long gaps */
+        while (dt > U32_MAX) {
+            dt  >>= 1;
+            off >>= 1;
+        }
+        out[k] = p[i].temp +
+                 div64_s64((s64)(p[i + 1].temp - p[i].temp) * off, dt);
+    }
 }
 
-/* Read temperature and return micro-degrees Celsius */
-static int read_temperature(struct i2c_client *client)
+static long mcp9808_history(struct mcp9808_history_query __user *uq)
 {
-    uint8_t reg = MCP9808_TEMP_REG, buf[2];
-    int ret, temp_uc;
-    uint8_t hi, lo;
+    struct mcp9808_history_query q;
+    struct mcp9808_point *series;
+    struct mcp9808_data *d;
+    s32 __user *out;
+    s64 span, end;
+    unsigned int i, n, cap;
+    s32 *row;
+    long ret = 0;
 
-    ret = i2c_master_send(client, &reg, 1);
-    if (ret < 0) {
-        dev_err(&client->dev, "Write temp reg failed\n");
-        return ret;
+    if (copy_from_user(&q, uq, sizeof(q)))
+        return -EFAULT;
+    if (!q.nsensors || q.nsensors > MCP9808_MAX_DEVICES ||
+        !q.npoints || q.npoints > MCP9808_HISTORY_MAX_POINTS ||
+        q.step_ns <= 0 || q.reserved ||
+        (q.mode != MCP9808_RESAMPLE_NEAREST &&
+         q.mode != MCP9808_RESAMPLE_LINEAR))
+        return -EINVAL;
+    if (check_mul_overflow(q.step_ns, (s64)q.npoints, &span) ||
+        check_add_overflow(q.start_ns, span, &end))
+        return -EINVAL;
+    for (i = 0; i < q.nsensors; i++)
+        if (q.minors[i] >= MCP9808_MAX_DEVICES)
+            return -EINVAL;
+
+    /* tier means in range: at most one per second, plus the edges */
+    cap = min_t(u64, div64_u64(span, NSEC_PER_SEC) + 3,
+                mcp9808_tier_max_points());
+    series = kvmalloc_array(MCP9808_SAMPLE_POOL + cap, sizeof(*series),
+                            GFP_KERNEL);
+    row = kvmalloc_array(q.npoints, sizeof(*row), GFP_KERNEL);
+    if (!series || !row) {
+        ret = -ENOMEM;
+        goto out_free;
     }
 
-    ret = i2c_master_recv(client, buf, 2);
-    if (ret < 0) {
-        dev_err(&client->dev, "Read temp failed\n");
-        return ret;
+    out = u64_to_user_ptr(q.values);
+    mutex_lock(&mcp9808_devices_lock);
+    for (i = 0; i < q.nsensors; i++) {
+        d = mcp9808_devices[q.minors[i]];
+        if (!d) {
+            ret = -ENODEV;
+            break;
+        }
+        n = mcp9808_history_series(d, q.start_ns, end, series, cap);
+        mcp9808_resample(series, n, &q, row);
+        if (copy_to_user(out + (size_t)i * q.npoints, row,
+                         q.npoints * sizeof(*row))) {
+            ret = -EFAULT;
+            break;
+        }
     }
+    mutex_unlock(&mcp9808_devices_lock);
+
+out_free:
+    kvfree(row);
+    kvfree(series);
+    return ret;
+}
+
+/*
+ * Copy npoints consecutive points of one tier, starting at interval
+ * first, in chunks with d->lock dropped in between
+ */
+static void mcp9808_tier_read(struct mcp9808_data *d, unsigned int tier,
+                              u64 first, u32 npoints,
+                              struct mcp9808_tier_point *out)
+{
+    const struct mcp9808_tier *t = &d->tiers[tier];
+    const struct mcp9808_tier_cell *c;
+    u64 ns = (u64)mcp9808_tier_s[tier] * NSEC_PER_SEC;
+    u32 k, idx, slot, last, lim, chunk, lap;
 
-    hi = buf[0]; lo = buf[1];
-    if (hi & 0x80) dev_info(&client->dev, "TA >= TCRIT\n");
-    if (hi & 0x40) dev_info(&client->dev, "TA > TUPPER\n");
-    if (hi & 0x20) dev_info(&client->dev, "TA < TLOWER\n");
+    memset(out, 0, npoints * sizeof(*out));
+    for (k = 0; k < npoints; k++)
+        out[k].start_ns = (first + k) * ns;
+    if (first > U32_MAX)
+        return;
+    slot = first;
+    last = min_t(u64, first + npoints - 1, U32_MAX);
+
+    spin_lock(&d->lock);
+    for (;;) {
+        if (!t->npoints || !t->count)
+            break;
+        slot = max(slot, mcp9808_tier_oldest(t));
+        lim  = min(last, t->slot);
+        if (slot > lim)
+            break;
+        lap = slot / t->npoints;
+        idx = slot - lap * t->npoints;
+        for (chunk = 0; chunk < MCP9808_TIER_CHUNK && slot <= lim;
+             chunk++, slot++) {
+            c = &t->cells[idx];
+            if (mcp9808_tier_cell_valid(c, lap)) {
+                k = slot - first;
+                out[k].min   = c->min * MCP9808_TIER_UNIT;
+                out[k].max   = c->max * MCP9808_TIER_UNIT;
+                out[k].mean  = c->mean * MCP9808_TIER_UNIT;
+                out[k].count = c->count;
+            }
+            if (++idx == t->npoints) {
+                idx = 0;
+                lap++;
+            }
+        }
+        spin_unlock(&d->lock);
+        cond_resched();
+        spin_lock(&d->lock);
+    }
+    spin_unlock(&d->lock);
+}
 
-    hi &= 0x1F;  /* clear flag bits */
+static long mcp9808_tier_query(struct mcp9808_tier_query __user *uq)
+{
+    struct mcp9808_tier_query q;
+    struct mcp9808_tier_point __user *out;
+    struct mcp9808_tier_point *row;
+    struct mcp9808_data *d;
+    unsigned int i;
+    long ret = 0;
+    u64 first;
 
-    /* convert to micro-°C (×10⁴ then ÷16) */
-    if (hi & 0x10) {
-        /* negative */
-        hi &= 0x0F;
-        temp_uc = -((hi << 4) * 10000 + (lo * 10000) / 16);
-    } else {
-        temp_uc = (hi << 4) * 10000 + (lo * 10000) / 16;
+    if (copy_from_user(&q, uq, sizeof(q)))
+        return -EFAULT;
+    if (q.tier >= MCP9808_NR_TIERS || q.start_ns < 0 || q.reserved ||
+        !q.nsensors || q.nsensors > MCP9808_MAX_DEVICES ||
+        !q.npoints || q.npoints > MCP9808_HISTORY_MAX_POINTS)
+        return -EINVAL;
+    for (i = 0; i < q.nsensors; i++)
+        if (q.minors[i] >= MCP9808_MAX_DEVICES)
+            return -EINVAL;
+    first = div64_u64(q.start_ns, (u64)mcp9808_tier_s[q.tier] * NSEC_PER_SEC);
+
+    row = kvmalloc_array(q.npoints, sizeof(*row), GFP_KERNEL);
+    if (!row)
+        return -ENOMEM;
+
+    out = u64_to_user_ptr(q.points);
+    mutex_lock(&mcp9808_devices_lock);
+    for (i = 0; i < q.nsensors; i++) {
+        d = mcp9808_devices[q.minors[i]];
+        if (!d) {
+            ret = -ENODEV;
+            break;
+        }
+        mcp9808_tier_read(d, q.tier, first, q.npoints, row);
+        if (copy_to_user(out + (size_t)i * q.npoints, row,
+                         q.npoints * sizeof(*row))) {
+            ret = -EFAULT;
+            break;
+        }
     }
+    mutex_unlock(&mcp9808_devices_lock);
 
-    dev_info(&client->dev,
-             "Raw temp: %02X %02X → %d.%04d°C\n",
-             hi, lo, temp_uc/10000, abs(temp_uc)%10000);
-    return temp_uc;
+    kvfree(row);
+    return ret;
 }
 
-/* char dev read() */
-static ssize_t mcp9808_read(struct file *file, char __user *buf,
-                            size_t count, loff_t *offset)
+static long mcp9808_all_ioctl(struct file *file, unsigned int cmd,
+                              unsigned long arg)
 {
-    struct mcp9808_data *d = file->private_data;
-    int temp_uc = read_temperature(d->client);
-    char tmp[32];
-    int len;
+    switch (cmd) {
+    case MCP9808_IOC_HISTORY:
+        return mcp9808_history((void __user *)arg);
+    case MCP9808_IOC_TIERS:
+        return mcp9808_tier_query((void __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+static const struct file_operations mcp9808_all_fops = {
+    .owner          = THIS_MODULE,
+    .open           = nonseekable_open,
+    .mmap           = mcp9808_all_mmap,
+    .unlocked_ioctl = mcp9808_all_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+};
+
+/* /dev/mcp9808-blackbox: samples recovered from the previous boot */
+static ssize_t mcp9808_bb_read(struct file *file, char __user *buf,
+                               size_t count, loff_t *offset)
+{
+    return simple_read_from_buffer(buf, count, offset, mcp9808_bb_saved,
+                                   mcp9808_bb_saved_len);
+}
+
+static const struct file_operations mcp9808_bb_fops = {
+    .owner          = THIS_MODULE,
+    .read           = mcp9808_bb_read,
+    .llseek         = default_llseek,
+};
 
-    if (temp_uc < 0)
-        return temp_uc;
+static int mcp9808_bb_cmp(const void *a, const void *b)
+{
+    const struct mcp9808_blackbox_sample *x = a, *y = b;
+
+    return x->realtime_ns < y->realtime_ns ? -1 :
+           x->realtime_ns > y->realtime_ns;
+}
 
-    len = snprintf(tmp, sizeof(tmp), "%d.%04d\n",
-                   temp_uc/10000, abs(temp_uc)%10000);
+/*
+ * Copy out the ring a previous boot left behind.  No write position is
+ * kept, so the records carrying the valid bit are sorted by tick (which
+ * wraps only after about 417 days of uptime).
+ */
+static int mcp9808_bb_recover(void)
+{
+    u32 n = mcp9808_bb->nrecords, i;
+    struct mcp9808_blackbox_sample *out;
+    size_t count = 0, valid = 0;
+    u64 rec;
 
-    if (*offset >= len)
+    for (i = 0; i < n; i++)
+        count += mcp9808_bb_records[i] >> 56;
+    if (!count)
         return 0;
-    if (copy_to_user(buf, tmp, len))
-        return -EFAULT;
 
-    *offset += len;
-    return len;
+    out = kvmalloc_array(count, sizeof(*out), GFP_KERNEL);
+    if (!out)
+        return -ENOMEM;
+
+    for (i = 0; i < n && valid < count; i++) {
+        rec = mcp9808_bb_records[i];
+        if (!(rec >> 56))
+            continue;
+        out[valid].realtime_ns = mcp9808_bb->real_base_ns +
+                                 ((s64)(u32)rec << MCP9808_BB_TICK_SHIFT);
+        out[valid].raw   = rec >> 32;
+        out[valid].minor = rec >> 48;
+        out[valid].temp  = mcp9808_raw_to_temp(out[valid].raw);
+        out[valid].flags = mcp9808_raw_flags(out[valid].raw);
+        valid++;
+    }
+    sort(out, valid, sizeof(*out), mcp9808_bb_cmp, NULL);
+
+    mcp9808_bb_saved = out;
+    mcp9808_bb_saved_len = valid * sizeof(*out);
+    pr_info("%s: recovered %zu black box samples\n", DEVICE_NAME, valid);
+    return 0;
 }
 
-/* open() */
-static int mcp9808_open(struct inode *inode, struct file *file)
+/* Map the black box region, recover the last boot and start a new ring */
+static int mcp9808_bb_init(void)
 {
-    struct mcp9808_data *d =
-        container_of(inode->i_cdev, struct mcp9808_data, cdev);
-    file->private_data = d;
-    dev_info(&d->client->dev, "Device opened\n");
+    struct device *dev;
+    u64 n;
+    int ret;
+
+    if (!blackbox_size)
+        return 0;
+
+    n = (blackbox_size - min_t(unsigned long, blackbox_size,
+                               sizeof(*mcp9808_bb))) / sizeof(u64);
+    if (!n) {
+        pr_err("%s: black box too small\n", DEVICE_NAME);
+        return -EINVAL;
+    }
+    n = rounddown_pow_of_two(min_t(u64, n, U32_MAX));
+
+    /* write-combined like ramoops: stores reach RAM without a cache flush */
+    mcp9808_bb = memremap(blackbox_addr, blackbox_size, MEMREMAP_WC);
+    if (!mcp9808_bb) {
+        pr_err("%s: cannot map black box at %#lx\n", DEVICE_NAME,
+               blackbox_addr);
+        return -ENOMEM;
+    }
+    mcp9808_bb_records = (u64 *)(mcp9808_bb + 1);
+
+    if (mcp9808_bb->magic == MCP9808_BB_MAGIC && mcp9808_bb->nrecords == n) {
+        ret = mcp9808_bb_recover();
+        if (ret)
+            goto err_unmap;
+    }
+
+    /* the valid bit alone marks this boot's records */
+    memset(mcp9808_bb_records, 0, n * sizeof(u64));
+    mcp9808_bb_base_ns = ktime_get_boottime_ns();
+    mcp9808_bb_mask = n - 1;
+    mcp9808_bb->magic        = MCP9808_BB_MAGIC;
+    mcp9808_bb->nrecords     = n;
+    mcp9808_bb->boot_base_ns = mcp9808_bb_base_ns;
+    mcp9808_bb->real_base_ns = ktime_get_real_ns();
+    atomic64_set(&mcp9808_bb_head, 0);
+
+    cdev_init(&mcp9808_bb_cdev, &mcp9808_bb_fops);
+    mcp9808_bb_cdev.owner = THIS_MODULE;
+    ret = cdev_add(&mcp9808_bb_cdev, mcp9808_dev + MCP9808_BB_MINOR, 1);
+    if (ret)
+        goto err_free;
+
+    dev = device_create(mcp9808_class, NULL, mcp9808_dev + MCP9808_BB_MINOR,
+                        NULL, DEVICE_NAME "-blackbox");
+    if (IS_ERR(dev)) {
+        ret = PTR_ERR(dev);
+        goto err_cdev;
+    }
     return 0;
+
+err_cdev:
+    cdev_del(&mcp9808_bb_cdev);
+err_free:
+    kvfree(mcp9808_bb_saved);
+err_unmap:
+    memunmap(mcp9808_bb);
+    mcp9808_bb = NULL;
+    return ret;
 }
 
-static const struct file_operations mcp9808_fops = {
-    .owner   = THIS_MODULE,
-    .open    = mcp9808_open,
-    .read    = mcp9808_read,
+static void mcp9808_bb_exit(void)
+{
+    if (!mcp9808_bb)
+        return;
+    device_destroy(mcp9808_class, mcp9808_dev + MCP9808_BB_MINOR);
+    cdev_del(&mcp9808_bb_cdev);
+    kvfree(mcp9808_bb_saved);
+    memunmap(mcp9808_bb);
+}
+
+/* sysfs: alert limits in °C × 10⁴ */
+static ssize_t mcp9808_limit_show(struct device *dev, int idx, char *buf)
+{
+    struct mcp9808_data *d = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(d->limit[idx]));
+}
+
+static ssize_t mcp9808_limit_store(struct device *dev, int idx,
+                                   const char *buf, size_t count)
+{
+    struct mcp9808_data *d = dev_get_drvdata(dev);
+    u16 reg;
+    s32 val;
+    int ret;
+
+    ret = kstrtos32(buf, 10, &val);
+    if (ret)
+        return ret;
+
+    reg = mcp9808_temp_to_limit(val);
+    ret = i2c_smbus_write_word_swapped(d->client, mcp9808_limit_reg[idx], reg);
+    if (ret < 0)
+        return ret;
+
+    WRITE_ONCE(d->limit[idx], mcp9808_raw_to_temp(reg));
+    return count;
+}
+
+#define MCP9808_LIMIT_ATTR(_name, _idx)                                 \
+static ssize_t _name##_show(struct device *dev,                         \
+                            struct device_attribute *attr, char *buf)   \
+{                                                                       \
+    return mcp9808_limit_show(dev, _idx, buf);                          \
+}                                                                       \
+static ssize_t _name##_store(struct device *dev,                        \
+                             struct device_attribute *attr,             \
+                             const char *buf, size_t count)             \
+{                                                                       \
+    return mcp9808_limit_store(dev, _idx, buf, count);                  \
+}                                                                       \
+static DEVICE_ATTR_RW(_name)
+
+MCP9808_LIMIT_ATTR(temp_upper, MCP9808_UPPER);
+MCP9808_LIMIT_ATTR(temp_lower, MCP9808_LOWER);
+MCP9808_LIMIT_ATTR(temp_crit,  MCP9808_CRIT);
+
+/* sysfs: forecast horizon in ms */
+static ssize_t forecast_horizon_ms_show(struct device *dev,
+                                        struct device_attribute *attr,
+                                        char *buf)
+{
+    struct mcp9808_data *d = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(d->horizon_ms));
+}
+
+static ssize_t forecast_horizon_ms_store(struct device *dev,
+                                         struct device_attribute *attr,
+                                         const char *buf, size_t count)
+{
+    struct mcp9808_data *d = dev_get_drvdata(dev);
+    u32 val;
+    int ret;
+
+    ret = kstrtou32(buf, 10, &val);
+    if (ret)
+        return ret;
+    if (val > MCP9808_HORIZON_MAX_MS)
+        return -EINVAL;
+
+    WRITE_ONCE(d->horizon_ms, val);
+    return count;
+}
+static DEVICE_ATTR_RW(forecast_horizon_ms);
+
+static struct attribute *mcp9808_attrs[] = {
+    &dev_attr_temp_upper.attr,
+    &dev_attr_temp_lower.attr,
+    &dev_attr_temp_crit.attr,
+    &dev_attr_forecast_horizon_ms.attr,
+    NULL
+};
+
+static const struct attribute_group mcp9808_group = {
+    .attrs = mcp9808_attrs,
+};
+
+/* sysfs: stats/ counters */
+#define MCP9808_STAT_ATTR(_name)                                        \
+static ssize_t _name##_show(struct device *dev,                         \
+                            struct device_attribute *attr, char *buf)   \
+{                                                                       \
+    struct mcp9808_data *d = dev_get_drvdata(dev);                      \
+    return sysfs_emit(buf, "%lu\n", READ_ONCE(d->stats._name));         \
+}                                                                       \
+static DEVICE_ATTR_RO(_name)
+
+MCP9808_STAT_ATTR(bus_reads);
+MCP9808_STAT_ATTR(batched_reads);
+MCP9808_STAT_ATTR(alerts);
+MCP9808_STAT_ATTR(sample_overruns);
+MCP9808_STAT_ATTR(event_overruns);
+MCP9808_STAT_ATTR(alert_storms);
+MCP9808_STAT_ATTR(alerts_coalesced);
+
+static struct attribute *mcp9808_stats_attrs[] = {
+    &dev_attr_bus_reads.attr,
+    &dev_attr_batched_reads.attr,
+    &dev_attr_alerts.attr,
+    &dev_attr_sample_overruns.attr,
+    &dev_attr_event_overruns.attr,
+    &dev_attr_alert_storms.attr,
+    &dev_attr_alerts_coalesced.attr,
+    NULL
+};
+
+static const struct attribute_group mcp9808_stats_group = {
+    .name  = "stats",
+    .attrs = mcp9808_stats_attrs,
 };
 
+static const struct attribute_group *mcp9808_groups[] = {
+    &mcp9808_group,
+    &mcp9808_stats_group,
+    NULL
+};
+
+/* Cache the alert limits so sysfs reads do not touch the bus */
+static int mcp9808_read_limits(struct mcp9808_data *d)
+{
+    int i, ret;
+
+    for (i = 0; i < MCP9808_NR_LIMITS; i++) {
+        ret = i2c_smbus_read_word_swapped(d->client, mcp9808_limit_reg[i]);
+        if (ret < 0) {
+            dev_err(&d->client->dev, "Failed to read limits\n");
+            return ret;
+        }
+        d->limit[i] = mcp9808_raw_to_temp(ret);
+    }
+    return 0;
+}
+
+/* Carve all tier rings of a sensor out of one allocation */
+static int mcp9808_alloc_tiers(struct mcp9808_data *d)
+{
+    struct mcp9808_tier_cell *cells;
+    size_t total = 0;
+    int i;
+
+    for (i = 0; i < MCP9808_NR_TIERS; i++)
+        total += tier_points[i];
+    if (!total)
+        return 0;
+
+    BUILD_BUG_ON(sizeof(*cells) != 8);
+    cells = kvcalloc(total, sizeof(*cells), GFP_KERNEL);
+    if (!cells)
+        return -ENOMEM;
+    for (i = 0; i < MCP9808_NR_TIERS; i++) {
+        d->tiers[i].cells   = cells;
+        d->tiers[i].npoints = tier_points[i];
+        cells += tier_points[i];
+    }
+    return 0;
+}
+
+/* Drop the bound device's reference; open files may still hold theirs */
+static void mcp9808_put_data(void *data)
+{
+    struct mcp9808_data *d = data;
+
+    kref_put(&d->ref, mcp9808_free_data);
+}
+
 /* Probe: read DT reg, init device, create char device */
 static int mcp9808_probe(struct i2c_client *client)
 {
@@ -129,61 +2289,121 @@ static int mcp9808_probe(struct i2c_client *client)
     u32 addr;
     int ret;
 
-    if (!np) {
-        dev_err(&client->dev, "No device tree node\n");
-        return -EINVAL;
+    if (np) {
+        ret = of_property_read_u32(np, "reg", &addr);
+        if (ret) {
+            dev_err(&client->dev, "Missing 'reg' DT property\n");
+            return ret;
+        }
+        if (addr != client->addr)
+            dev_warn(&client->dev,
+                     "DT reg=0x%02x != client->addr=0x%02x\n",
+                     addr, client->addr);
     }
 
-    ret = of_property_read_u32(np, "reg", &addr);
-    if (ret) {
-        dev_err(&client->dev, "Missing 'reg' DT property\n");
+    /* not devm: an open file may outlive the binding */
+    d = kzalloc(sizeof(*d), GFP_KERNEL);
+    if (!d)
+        return -ENOMEM;
+    kref_init(&d->ref);
+    ret = devm_add_action_or_reset(&client->dev, mcp9808_put_data, d);
+    if (ret)
         return ret;
-    }
-    if (addr != client->addr)
-        dev_warn(&client->dev,
-                 "DT reg=0x%02x != client->addr=0x%02x\n",
-                 addr, client->addr);
 
-    d = devm_kzalloc(&client->dev, sizeof(*d), GFP_KERNEL);
-    if (!d)
+    d->samples = kcalloc(MCP9808_SAMPLE_POOL, sizeof(*d->samples),
+                         GFP_KERNEL);
+    d->events  = kcalloc(MCP9808_EVENT_POOL, sizeof(*d->events), GFP_KERNEL);
+    if (!d->samples || !d->events)
         return -ENOMEM;
 
     d->client = client;
+    init_rwsem(&d->remove_lock);
+    d->horizon_ms = 60 * MSEC_PER_SEC;
+    spin_lock_init(&d->lock);
+    init_waitqueue_head(&d->wait);
+    mutex_init(&d->sub_lock);
+    INIT_LIST_HEAD(&d->files);
+    d->thresholds = RB_ROOT;
     i2c_set_clientdata(client, d);
 
+    ret = mcp9808_alloc_tiers(d);
+    if (ret)
+        return ret;
+
     dev_info(&client->dev, "Probing MCP9808@0x%02x\n", client->addr);
 
     ret = set_resolution(client);
     if (ret)
         return ret;
 
-    ret = alloc_chrdev_region(&mcp9808_dev, 0, 1, DEVICE_NAME);
-    if (ret) {
-        dev_err(&client->dev, "alloc_chrdev_region failed\n");
+    ret = mcp9808_read_limits(d);
+    if (ret)
         return ret;
+
+    d->irq = mcp9808_find_alert_irq(d);
+    if (d->irq < 0)
+        return dev_err_probe(&client->dev, d->irq, "No ALERT IRQ\n");
+
+    d->minor = ida_alloc_max(&mcp9808_ida, MCP9808_MAX_DEVICES - 1,
+                             GFP_KERNEL);
+    if (d->minor < 0) {
+        dev_err(&client->dev, "Too many sensors\n");
+        return d->minor;
+    }
+
+    ret = mcp9808_bus_attach(d);
+    if (ret)
+        goto err_ida;
+
+    /* an ALERT pending already publishes at once, so the minor must be set */
+    if (d->irq > 0) {
+        ret = mcp9808_setup_alert(d);
+        if (ret)
+            goto err_bus;
     }
 
-    cdev_init(&d->cdev, &mcp9808_fops);
-    d->cdev.owner = THIS_MODULE;
-    ret = cdev_add(&d->cdev, mcp9808_dev, 1);
+    /* open() looks the sensor up here and takes a reference */
+    mutex_lock(&mcp9808_devices_lock);
+    mcp9808_devices[d->minor] = d;
+    mutex_unlock(&mcp9808_devices_lock);
+
+    /* allocated apart from d so a racing open never touches freed memory */
+    d->cdev = cdev_alloc();
+    if (!d->cdev) {
+        ret = -ENOMEM;
+        goto err_registry;
+    }
+    d->cdev->ops   = &mcp9808_fops;
+    d->cdev->owner = THIS_MODULE;
+    ret = cdev_add(d->cdev, mcp9808_dev + d->minor, 1);
     if (ret) {
         dev_err(&client->dev, "cdev_add failed\n");
-        unregister_chrdev_region(mcp9808_dev, 1);
-        return ret;
+        kobject_put(&d->cdev->kobj);
+        goto err_registry;
     }
 
-    mcp9808_class = class_create(DEVICE_NAME);
-    if (IS_ERR(mcp9808_class)) {
-        ret = PTR_ERR(mcp9808_class);
-        dev_err(&client->dev, "class_create failed\n");
-        cdev_del(&d->cdev);
-        unregister_chrdev_region(mcp9808_dev, 1);
-        return ret;
-    }
+    /* the first sensor keeps the historical /dev/mcp9808 name */
+    if (d->minor)
+        device_create(mcp9808_class, &client->dev, mcp9808_dev + d->minor,
+                      d, DEVICE_NAME "-%d", d->minor);
+    else
+        device_create(mcp9808_class, &client->dev, mcp9808_dev, d,
+                      DEVICE_NAME);
 
-    device_create(mcp9808_class, NULL, mcp9808_dev, NULL, DEVICE_NAME);
     dev_info(&client->dev, "%s initialized\n", DEVICE_NAME);
     return 0;
+
+err_registry:
+    mutex_lock(&mcp9808_devices_lock);
+    mcp9808_devices[d->minor] = NULL;
+    mutex_unlock(&mcp9808_devices_lock);
+err_alert:
+    mcp9808_free_alert(d);
+err_bus:
+    mcp9808_bus_detach(d);
+err_ida:
+    ida_free(&mcp9808_ida, d->minor);
+    return ret;
 }
 
 /* Remove: undo probe */
@@ -191,10 +2411,27 @@ static void mcp9808_remove(struct i2c_client *client)
 {
     struct mcp9808_data *d = i2c_get_clientdata(client);
 
-    device_destroy(mcp9808_class, mcp9808_dev);
-    class_destroy(mcp9808_class);
-    cdev_del(&d->cdev);
-    unregister_chrdev_region(mcp9808_dev, 1);
+    mutex_lock(&mcp9808_devices_lock);
+    mcp9808_devices[d->minor] = NULL;
+    mutex_unlock(&mcp9808_devices_lock);
+
+    device_destroy(mcp9808_class, mcp9808_dev + d->minor);
+    cdev_del(d->cdev);
+
+    /* files still open keep d, but no longer reach the client or bus */
+    down_write(&d->remove_lock);
+    WRITE_ONCE(d->dead, true);
+    up_write(&d->remove_lock);
+    wake_up_interruptible(&d->wait);
+    mcp9808_bus_detach(d);
+
+    /* nothing may publish a sample once the slot and minor are released */
+    mcp9808_free_alert(d);
+
+    spin_lock(&d->lock);
+    mcp9808_set_latest(d->minor, NULL);
+    spin_unlock(&d->lock);
+    ida_free(&mcp9808_ida, d->minor);
 
     dev_info(&client->dev, "%s removed\n", DEVICE_NAME);
 }
@@ -217,13 +2454,87 @@ static struct i2c_driver mcp9808_driver = {
     .driver = {
         .name           = "mcp9808",
         .of_match_table = of_match_ptr(mcp9808_of_match),
+        .dev_groups     = mcp9808_groups,
     },
     .probe      = mcp9808_probe,
     .remove     = mcp9808_remove,
     .id_table   = mcp9808_id,
 };
 
-module_i2c_driver(mcp9808_driver);
+static int __init mcp9808_init(void)
+{
+    struct device *dev;
+    dev_t all;
+    int ret;
+
+    BUILD_BUG_ON(MCP9808_LATEST_ENTRIES * sizeof(*mcp9808_latest_page) > PAGE_SIZE);
+    mcp9808_latest_page = (void *)get_zeroed_page(GFP_KERNEL);
+    if (!mcp9808_latest_page)
+        return -ENOMEM;
+
+    ret = alloc_chrdev_region(&mcp9808_dev, 0, MCP9808_NR_MINORS,
+                              DEVICE_NAME);
+    if (ret) {
+        pr_err("%s: alloc_chrdev_region failed\n", DEVICE_NAME);
+        goto err_page;
+    }
+    all = mcp9808_dev + MCP9808_ALL_MINOR;
+
+    mcp9808_class = class_create(DEVICE_NAME);
+    if (IS_ERR(mcp9808_class)) {
+        ret = PTR_ERR(mcp9808_class);
+        pr_err("%s: class_create failed\n", DEVICE_NAME);
+        goto err_region;
+    }
+
+    cdev_init(&mcp9808_all_cdev, &mcp9808_all_fops);
+    mcp9808_all_cdev.owner = THIS_MODULE;
+    ret = cdev_add(&mcp9808_all_cdev, all, 1);
+    if (ret)
+        goto err_class;
+
+    dev = device_create(mcp9808_class, NULL, all, NULL, DEVICE_NAME "-all");
+    if (IS_ERR(dev)) {
+        ret = PTR_ERR(dev);
+        goto err_cdev;
+    }
+
+    ret = mcp9808_bb_init();
+    if (ret)
+        goto err_device;
+
+    ret = i2c_add_driver(&mcp9808_driver);
+    if (ret)
+        goto err_bb;
+    return 0;
+
+err_bb:
+    mcp9808_bb_exit();
+err_device:
+    device_destroy(mcp9808_class, all);
+err_cdev:
+    cdev_del(&mcp9808_all_cdev);
+err_class:
+    class_destroy(mcp9808_class);
+err_region:
+    unregister_chrdev_region(mcp9808_dev, MCP9808_NR_MINORS);
+err_page:
+    free_page((unsigned long)mcp9808_latest_page);
+    return ret;
+}
+module_init(mcp9808_init);
+
+static void __exit mcp9808_exit(void)
+{
+    i2c_del_driver(&mcp9808_driver);
+    mcp9808_bb_exit();
+    device_destroy(mcp9808_class, mcp9808_dev + MCP9808_ALL_MINOR);
+    cdev_del(&mcp9808_all_cdev);
+    class_destroy(mcp9808_class);
+    unregister_chrdev_region(mcp9808_dev, MCP9808_NR_MINORS);
+    free_page((unsigned long)mcp9808_latest_page);
+}
+module_exit(mcp9808_exit);
 
 MODULE_AUTHOR("XY");
 MODULE_DESCRIPTION("MCP9808 temperature sensor driver");
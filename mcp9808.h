@@ -0,0 +1,198 @@
+/*
+ * mcp9808.h — Userspace interface of the MCP9808 character device
+ *
+ * Temperatures are in units of 10⁻⁴ °C, the same scale the text
+ * interface prints with four decimals.  Timestamps are CLOCK_MONOTONIC
+ * nanoseconds.
+ */
+
+#ifndef _MCP9808_H
+#define _MCP9808_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Limit flags latched in the temperature register */
+#define MCP9808_FLAG_LOWER   (1 << 0)    /* TA < TLOWER */
+#define MCP9808_FLAG_UPPER   (1 << 1)    /* TA > TUPPER */
+#define MCP9808_FLAG_CRIT    (1 << 2)    /* TA >= TCRIT */
+
+/*
+ * One temperature conversion read from the sensor, with the driver's
+ * short-horizon forecast (Holt double exponential smoothing) attached.
+ * The eta fields estimate when the trend crosses a limit: -1 while not
+ * heading towards it, 0 once at or beyond it.
+ */
+struct mcp9808_sample {
+    __u64 seq;
+    __s64 timestamp_ns;
+    __s32 temp;
+    __u16 raw;                           /* temperature register as read */
+    __u16 flags;                         /* MCP9808_FLAG_* */
+    __s32 forecast;                      /* temp forecast_horizon_ms ahead */
+    __s32 upper_eta_ms;                  /* until TUPPER is crossed */
+    __s32 crit_eta_ms;                   /* until TCRIT is crossed */
+    __u32 reserved;
+};
+
+/*
+ * Latest sample of every sensor: /dev/mcp9808-all maps one read-only
+ * page holding MCP9808_LATEST_ENTRIES of these, indexed by minor (0 for
+ * /dev/mcp9808, N for /dev/mcp9808-N).  seq is odd while the driver
+ * updates the entry; timestamp_ns is 0 for a slot without a sensor or
+ * sample.  Use mcp9808_latest_read() for a consistent copy.
+ */
+struct mcp9808_latest {
+    __s64 timestamp_ns;
+    __s32 temp;
+    __u16 raw;
+    __u16 flags;
+    __u32 seq;
+    __u32 reserved;
+};
+
+#define MCP9808_LATEST_ENTRIES  64
+
+/*
+ * Samples recovered from the persistent black box of the previous boot,
+ * read() from /dev/mcp9808-blackbox oldest first.  Timestamps have a
+ * resolution of 2^23 ns (about 8 ms).
+ */
+struct mcp9808_blackbox_sample {
+    __s64 realtime_ns;                   /* CLOCK_REALTIME */
+    __s32 temp;
+    __u16 raw;
+    __u8  minor;                         /* sensor, as in mcp9808_latest */
+    __u8  flags;
+};
+
+/*
+ * History query on /dev/mcp9808-all: the recent samples of nsensors
+ * sensors (minors, as in mcp9808_latest) resampled onto the grid
+ * start_ns + k * step_ns, k < npoints.  values points to an
+ * nsensors × npoints array of __s32 filled row by row, with
+ * MCP9808_NO_VALUE where a sensor has no history around a point.
+ * Points older than the recent samples come from the retention tiers.
+ */
+#define MCP9808_RESAMPLE_NEAREST 0
+#define MCP9808_RESAMPLE_LINEAR  1
+#define MCP9808_NO_VALUE     (-0x7fffffff - 1)
+
+struct mcp9808_history_query {
+    __s64 start_ns;                      /* CLOCK_MONOTONIC */
+    __s64 step_ns;
+    __u32 npoints;                       /* at most 65536 */
+    __u32 nsensors;
+    __u32 mode;                          /* MCP9808_RESAMPLE_* */
+    __u32 reserved;                      /* must be 0 */
+    __u64 values;                        /* user pointer to the matrix */
+    __u8  minors[MCP9808_LATEST_ENTRIES];
+};
+
+/*
+ * Retention tiers: every sensor consolidates its samples into fixed-size
+ * rings of 1 s, 1 min and 1 h points (sizes set by the tier_points module
+ * parameter).  MCP9808_IOC_TIERS on /dev/mcp9808-all reads npoints
+ * consecutive points of one tier, starting with the interval containing
+ * start_ns, for nsensors sensors into an nsensors × npoints array.
+ */
+#define MCP9808_TIER_SECOND  0
+#define MCP9808_TIER_MINUTE  1
+#define MCP9808_TIER_HOUR    2
+#define MCP9808_NR_TIERS     3
+
+struct mcp9808_tier_point {
+    __s64 start_ns;                      /* CLOCK_MONOTONIC, interval start */
+    __s32 min;
+    __s32 max;
+    __s32 mean;                          /* rounded to 1/16 °C */
+    __u32 count;                         /* samples; 0 = no data */
+};
+
+struct mcp9808_tier_query {
+    __s64 start_ns;
+    __u32 tier;                          /* MCP9808_TIER_* */
+    __u32 npoints;                       /* at most 65536 */
+    __u32 nsensors;
+    __u32 reserved;                      /* must be 0 */
+    __u64 points;                        /* user pointer to the matrix */
+    __u8  minors[MCP9808_LATEST_ENTRIES];
+};
+
+/* Event types */
+#define MCP9808_EVENT_ALERT  1           /* ALERT pin asserted */
+#define MCP9808_EVENT_FORECAST 2         /* limit in flags forecast within
+                                            the horizon; temp = forecast */
+#define MCP9808_EVENT_RISING 3           /* software threshold reached;
+                                            temp = threshold */
+#define MCP9808_EVENT_FALLING 4          /* dropped below a threshold */
+#define MCP9808_EVENT_STORM  5           /* count further alerts coalesced
+                                            during an ALERT storm; temp =
+                                            temperature at the summary, or
+                                            MCP9808_NO_VALUE if unread */
+
+/*
+ * Events are numbered per device in one sequence; a file sees the shared
+ * ALERT/FORECAST events and its own threshold events merged in seq order.
+ */
+struct mcp9808_event {
+    __u64 seq;
+    __s64 timestamp_ns;                  /* hard IRQ time for ALERT, else
+                                            the sample's */
+    __s32 temp;
+    __u16 type;                          /* MCP9808_EVENT_* */
+    __u16 flags;                         /* MCP9808_FLAG_* at event time */
+    __u32 count;                         /* events represented, 1 but for
+                                            MCP9808_EVENT_STORM */
+    __u32 reserved;
+};
+
+/* read() formats, selected with MCP9808_IOC_SET_MODE */
+#define MCP9808_MODE_TEXT    0           /* current temperature as text */
+#define MCP9808_MODE_BINARY  1           /* stream of struct mcp9808_sample */
+
+#define MCP9808_IOC_MAGIC    0x98
+
+/* Fetch the oldest unread event; -EAGAIN if none.  Wait with POLLPRI. */
+#define MCP9808_IOC_GET_EVENT  _IOR(MCP9808_IOC_MAGIC, 1, struct mcp9808_event)
+/* Select MCP9808_MODE_* for read() on this file */
+#define MCP9808_IOC_SET_MODE   _IOW(MCP9808_IOC_MAGIC, 2, __u32)
+/*
+ * Request a sampling rate in mHz for this file, 0 to unsubscribe.  The
+ * device is polled once at the highest rate requested by any file and
+ * binary reads deliver every sample decimated to the file's own rate.
+ */
+#define MCP9808_IOC_SET_RATE   _IOW(MCP9808_IOC_MAGIC, 3, __u32)
+/*
+ * Register or drop a software threshold (°C × 10⁴) on this file.  Its
+ * crossings queue MCP9808_EVENT_RISING/FALLING for this file only.
+ * Adding a duplicate fails with EEXIST, more than 4096 with ENOSPC.
+ */
+#define MCP9808_IOC_ADD_THRESHOLD _IOW(MCP9808_IOC_MAGIC, 4, __s32)
+#define MCP9808_IOC_DEL_THRESHOLD _IOW(MCP9808_IOC_MAGIC, 5, __s32)
+/* /dev/mcp9808-all: fill a history matrix; ENODEV for a minor without sensor */
+#define MCP9808_IOC_HISTORY    _IOW(MCP9808_IOC_MAGIC, 6, struct mcp9808_history_query)
+/* /dev/mcp9808-all: read retention tier points */
+#define MCP9808_IOC_TIERS      _IOW(MCP9808_IOC_MAGIC, 7, struct mcp9808_tier_query)
+
+#ifndef __KERNEL__
+/* Copy one entry of the latest-values page, retrying across updates */
+static inline void mcp9808_latest_read(const volatile struct mcp9808_latest *e,
+                                       struct mcp9808_latest *out)
+{
+    __u32 seq;
+
+    do {
+        seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        out->timestamp_ns = e->timestamp_ns;
+        out->temp  = e->temp;
+        out->raw   = e->raw;
+        out->flags = e->flags;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != e->seq);
+    out->seq = seq;
+    out->reserved = 0;
+}
+#endif
+
+#endif /* _MCP9808_H */
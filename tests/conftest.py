@@ -0,0 +1,99 @@
+import datetime
+import json
+import os
+import pathlib
+import platform
+import subprocess
+
+import pytest
+
+from mcp9808_helpers import ADDR, ADDR2, KO, PLAIN_KO, ROOT, loaded_sensor, \
+    run, stub_bus
+
+METRICS = pathlib.Path(os.environ.get("MCP9808_METRICS",
+                                      ROOT / "tests" / "metrics.jsonl"))
+SIM = pathlib.Path("/sys/kernel/config/gpio-sim/mcp9808-test")
+ALERT_LABEL = "mcp9808-test-alert"
+
+
+@pytest.fixture(scope="session")
+def i2c_stub():
+    """Bus number of an i2c-stub adapter emulating chips at ADDR, ADDR2."""
+    if os.geteuid() != 0:
+        pytest.skip("needs root to load modules")
+    if not KO.exists():
+        pytest.skip(f"{KO} not built")
+    try:
+        run("modprobe", "i2c-dev")
+        run("modprobe", "i2c-stub", f"chip_addr={ADDR:#x},{ADDR2:#x}")
+    except (OSError, subprocess.CalledProcessError) as e:
+        pytest.skip(f"i2c-stub unavailable: {e}")
+    yield stub_bus()
+    run("rmmod", "i2c-stub")
+
+
+@pytest.fixture(scope="session")
+def plain_i2c(i2c_stub):
+    """Bus number of tests/i2c-plain-stub, a plain-I2C twin of i2c_stub."""
+    if not PLAIN_KO.exists():
+        pytest.skip(f"{PLAIN_KO} not built (make test-modules)")
+    run("insmod", str(PLAIN_KO), f"chip_addr={ADDR:#x},{ADDR2:#x}")
+    yield stub_bus("I2C plain stub driver")
+    run("rmmod", "i2c-plain-stub")
+
+
+@pytest.fixture
+def sensor(i2c_stub):
+    with loaded_sensor(i2c_stub) as s:
+        yield s
+
+
+@pytest.fixture
+def alert_sensor(i2c_stub):
+    """Sensor whose ALERT input is line 0 of a gpio-sim chip.
+
+    Yields (sensor, pull) where pull is the sysfs file driving the line.
+    """
+    try:
+        run("modprobe", "gpio-sim")
+        (SIM / "bank0").mkdir(parents=True)
+    except (OSError, subprocess.CalledProcessError) as e:
+        pytest.skip(f"gpio-sim unavailable: {e}")
+    try:
+        (SIM / "bank0" / "num_lines").write_text("1")
+        (SIM / "bank0" / "label").write_text(ALERT_LABEL)
+        (SIM / "live").write_text("1")
+        chip = (SIM / "bank0" / "chip_name").read_text().strip()
+        dev = (SIM / "dev_name").read_text().strip()
+        pull = pathlib.Path(
+            f"/sys/devices/platform/{dev}/{chip}/sim_gpio0/pull")
+        pull.write_text("pull-up")
+        with loaded_sensor(i2c_stub, alert_chip=ALERT_LABEL,
+                           alert_line=0) as s:
+            yield s, pull
+    finally:
+        (SIM / "live").write_text("0")
+        (SIM / "bank0").rmdir()
+        SIM.rmdir()
+
+
+@pytest.fixture(scope="session")
+def metrics():
+    """Dict of performance figures, appended to METRICS as one JSON line."""
+    data = {}
+    yield data
+    if not data:
+        return
+    try:
+        rev = subprocess.run(["git", "-C", str(ROOT), "rev-parse", "HEAD"],
+                             capture_output=True, text=True).stdout.strip()
+    except OSError:
+        rev = ""
+    record = {
+        "time": datetime.datetime.now(datetime.timezone.utc).isoformat(),
+        "kernel": platform.release(),
+        "git": rev,
+        "metrics": data,
+    }
+    with METRICS.open("a") as f:
+        f.write(json.dumps(record, sort_keys=True) + "\n")
@@ -0,0 +1,130 @@
+/*
+ * i2c-plain-stub.c — test adapter for mcp9808.ko: like i2c-stub, but
+ * speaks plain I2C (I2C_FUNC_I2C) so the driver's batched
+ * i2c_transfer() path runs.
+ *
+ * Each chip at chip_addr is a file of 16-bit registers behind a register
+ * pointer, as on the MCP9808: a write sets the pointer and optionally
+ * one byte or one word (MSB first), a read returns the register at the
+ * pointer.  SMBus access is emulated by the I2C core, so i2cset/i2cget
+ * work as with i2c-stub.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/i2c.h>
+#include <linux/mutex.h>
+
+#define STUB_MAX_CHIPS 4
+#define STUB_NR_REGS   16
+
+static unsigned short chip_addr[STUB_MAX_CHIPS];
+static int nr_chips;
+module_param_array(chip_addr, ushort, &nr_chips, 0444);
+MODULE_PARM_DESC(chip_addr, "Chip addresses (up to 4)");
+
+struct stub_chip {
+    u8  ptr;
+    u16 regs[STUB_NR_REGS];
+};
+
+static struct stub_chip stub_chips[STUB_MAX_CHIPS];
+static DEFINE_MUTEX(stub_lock);
+static unsigned long stub_transfers;
+module_param(stub_transfers, ulong, 0444);
+MODULE_PARM_DESC(stub_transfers, "i2c_transfer() calls served");
+
+static struct stub_chip *stub_find(u16 addr)
+{
+    int i;
+
+    for (i = 0; i < nr_chips; i++)
+        if (chip_addr[i] == addr)
+            return &stub_chips[i];
+    return NULL;
+}
+
+static int stub_msg(struct stub_chip *c, struct i2c_msg *m)
+{
+    u16 *reg;
+
+    if (m->flags & I2C_M_RD) {
+        reg = &c->regs[c->ptr % STUB_NR_REGS];
+        if (m->len == 1) {
+            m->buf[0] = *reg;
+        } else if (m->len == 2) {
+            m->buf[0] = *reg >> 8;
+            m->buf[1] = *reg;
+        } else {
+            return -EOPNOTSUPP;
+        }
+        return 0;
+    }
+
+    if (!m->len || m->len > 3)
+        return -EOPNOTSUPP;
+    c->ptr = m->buf[0];
+    reg = &c->regs[c->ptr % STUB_NR_REGS];
+    if (m->len == 2)
+        *reg = m->buf[1];
+    else if (m->len == 3)
+        *reg = m->buf[1] << 8 | m->buf[2];
+    return 0;
+}
+
+static int stub_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+    struct stub_chip *c;
+    int i, ret = 0;
+
+    mutex_lock(&stub_lock);
+    stub_transfers++;
+    for (i = 0; i < num; i++) {
+        c = stub_find(msgs[i].addr);
+        if (!c) {
+            ret = -ENXIO;           /* NACK, like a missing chip */
+            break;
+        }
+        ret = stub_msg(c, &msgs[i]);
+        if (ret)
+            break;
+    }
+    mutex_unlock(&stub_lock);
+    return ret ? ret : num;
+}
+
+static u32 stub_func(struct i2c_adapter *adap)
+{
+    return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm stub_algo = {
+    .master_xfer    = stub_xfer,
+    .functionality  = stub_func,
+};
+
+static struct i2c_adapter stub_adapter = {
+    .owner  = THIS_MODULE,
+    .algo   = &stub_algo,
+    .name   = "I2C plain stub driver",
+};
+
+static int __init stub_init(void)
+{
+    if (!nr_chips) {
+        pr_err("i2c-plain-stub: chip_addr is required\n");
+        return -ENODEV;
+    }
+    return i2c_add_adapter(&stub_adapter);
+}
+
+static void __exit stub_exit(void)
+{
+    i2c_del_adapter(&stub_adapter);
+}
+
+module_init(stub_init);
+module_exit(stub_exit);
+
+MODULE_DESCRIPTION("Plain I2C register-file stub for mcp9808 tests");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,242 @@
+"""Helpers for driving mcp9808.ko against an emulated sensor.
+
+The sensor is an i2c-stub chip: registers are plain words we can set
+with i2cset, so tests control exactly what the driver reads.
+"""
+
+import collections
+import contextlib
+import ctypes
+import fcntl
+import os
+import pathlib
+import struct
+import subprocess
+import time
+
+ROOT = pathlib.Path(__file__).resolve().parent.parent
+KO = pathlib.Path(os.environ.get("MCP9808_KO", ROOT / "mcp9808.ko"))
+PLAIN_KO = ROOT / "tests" / "i2c-plain-stub.ko"    # make test-modules
+ADDR = 0x18
+ADDR2 = 0x19           # second emulated chip, /dev/mcp9808-1
+DEV = "/dev/mcp9808"
+DEV_ALL = "/dev/mcp9808-all"
+DEV_BLACKBOX = "/dev/mcp9808-blackbox"
+CONV_S = 0.13          # conversion time; text reads inside it are cached
+
+TEMP_REG = 0x05
+FLAG_LOWER, FLAG_UPPER, FLAG_CRIT = 1, 2, 4
+
+# mcp9808.h
+SAMPLE = struct.Struct("<QqiHHiiiI")
+Sample = collections.namedtuple(
+    "Sample", "seq ts temp raw flags forecast upper_eta_ms crit_eta_ms "
+              "reserved")
+EVENT = struct.Struct("<QqiHHII")
+Event = collections.namedtuple("Event",
+                               "seq ts temp type flags count reserved")
+LATEST = struct.Struct("<qiHHII")
+LATEST_ENTRIES = 64
+BLACKBOX = struct.Struct("<qiHBB")
+HISTORY_QUERY = struct.Struct("<qqIIIIQ64s")
+RESAMPLE_NEAREST, RESAMPLE_LINEAR = 0, 1
+NO_VALUE = -2**31
+TIER_QUERY = struct.Struct("<qIIIIQ64s")
+TIER_POINT = struct.Struct("<qiiiI")
+TierPoint = collections.namedtuple("TierPoint", "start_ns min max mean count")
+TIER_SECOND, TIER_MINUTE, TIER_HOUR = 0, 1, 2
+MODE_TEXT, MODE_BINARY = 0, 1
+EVENT_ALERT, EVENT_FORECAST, EVENT_RISING, EVENT_FALLING, EVENT_STORM = \
+    1, 2, 3, 4, 5
+
+
+def _ioc(direction, nr, size):
+    return (direction << 30) | (size << 16) | (0x98 << 8) | nr
+
+
+IOC_GET_EVENT = _ioc(2, 1, EVENT.size)
+IOC_SET_MODE = _ioc(1, 2, 4)
+IOC_SET_RATE = _ioc(1, 3, 4)
+IOC_ADD_THRESHOLD = _ioc(1, 4, 4)
+IOC_DEL_THRESHOLD = _ioc(1, 5, 4)
+IOC_HISTORY = _ioc(1, 6, HISTORY_QUERY.size)
+IOC_TIERS = _ioc(1, 7, TIER_QUERY.size)
+
+
+def run(*cmd):
+    return subprocess.run(cmd, check=True, capture_output=True, text=True)
+
+
+def temp_to_raw(celsius, flags=0):
+    """Temperature register value for celsius (1/16 °C resolution)."""
+    return (round(celsius * 16) & 0x1FFF) | (flags << 13)
+
+
+def parse_text(text):
+    return float(text.strip())
+
+
+class Sensor:
+    """One emulated MCP9808 bound to the driver."""
+
+    def __init__(self, bus, addr=ADDR, dev=DEV):
+        self.bus = bus
+        self.addr = addr
+        self.sysfs = pathlib.Path(f"/sys/bus/i2c/devices/{bus}-{addr:04x}")
+        self.dev = dev
+
+    def set_reg(self, reg, value):
+        # SMBus words go LSB first; the sensor (and driver) are MSB first
+        swapped = ((value & 0xFF) << 8) | (value >> 8)
+        run("i2cset", "-y", str(self.bus), hex(self.addr), hex(reg),
+            hex(swapped), "w")
+
+    def get_reg(self, reg):
+        word = int(run("i2cget", "-y", str(self.bus), hex(self.addr), hex(reg),
+                       "w").stdout, 16)
+        return ((word & 0xFF) << 8) | (word >> 8)
+
+    def set_temp(self, celsius, flags=0):
+        self.set_reg(TEMP_REG, temp_to_raw(celsius, flags))
+        time.sleep(CONV_S)
+
+    def attr(self, name):
+        return (self.sysfs / name).read_text().strip()
+
+    def set_attr(self, name, value):
+        (self.sysfs / name).write_text(str(value))
+
+    def stat(self, name):
+        return int(self.attr(f"stats/{name}"))
+
+    def read_text(self):
+        with open(self.dev) as f:
+            return f.read()
+
+    def open_stream(self, rate_mhz=0, nonblock=False):
+        """Open the device in binary mode subscribed at rate_mhz."""
+        flags = os.O_RDONLY | (os.O_NONBLOCK if nonblock else 0)
+        fd = os.open(self.dev, flags)
+        set_mode(fd, MODE_BINARY)
+        if rate_mhz:
+            set_rate(fd, rate_mhz)
+        return fd
+
+
+def set_mode(fd, mode):
+    fcntl.ioctl(fd, IOC_SET_MODE, struct.pack("I", mode))
+
+
+def set_rate(fd, rate_mhz):
+    fcntl.ioctl(fd, IOC_SET_RATE, struct.pack("I", rate_mhz))
+
+
+def read_samples(fd, count=1):
+    """Read up to count sample records as Sample tuples."""
+    data = os.read(fd, SAMPLE.size * count)
+    assert len(data) % SAMPLE.size == 0
+    return [Sample(*SAMPLE.unpack_from(data, off))
+            for off in range(0, len(data), SAMPLE.size)]
+
+
+def get_event(fd):
+    buf = fcntl.ioctl(fd, IOC_GET_EVENT, bytes(EVENT.size))
+    return Event(*EVENT.unpack(buf))
+
+
+def drain_events(fd):
+    """All pending events of a non-blocking fd."""
+    events = []
+    while True:
+        try:
+            events.append(get_event(fd))
+        except BlockingIOError:
+            return events
+
+
+def add_threshold(fd, temp):
+    fcntl.ioctl(fd, IOC_ADD_THRESHOLD, struct.pack("i", temp))
+
+
+def del_threshold(fd, temp):
+    fcntl.ioctl(fd, IOC_DEL_THRESHOLD, struct.pack("i", temp))
+
+
+def history(minors, start_ns, step_ns, npoints, mode=RESAMPLE_NEAREST):
+    """Resampled history matrix from /dev/mcp9808-all, one row per minor."""
+    out = (ctypes.c_int32 * (len(minors) * npoints))()
+    query = HISTORY_QUERY.pack(start_ns, step_ns, npoints, len(minors), mode,
+                               0, ctypes.addressof(out), bytes(minors))
+    fd = os.open(DEV_ALL, os.O_RDONLY)
+    try:
+        fcntl.ioctl(fd, IOC_HISTORY, query)
+    finally:
+        os.close(fd)
+    return [list(out[i * npoints:(i + 1) * npoints])
+            for i in range(len(minors))]
+
+
+def tiers(minors, tier, start_ns, npoints):
+    """Retention tier points from /dev/mcp9808-all, one row per minor."""
+    out = ctypes.create_string_buffer(len(minors) * npoints * TIER_POINT.size)
+    query = TIER_QUERY.pack(start_ns, tier, npoints, len(minors), 0,
+                            ctypes.addressof(out), bytes(minors))
+    fd = os.open(DEV_ALL, os.O_RDONLY)
+    try:
+        fcntl.ioctl(fd, IOC_TIERS, query)
+    finally:
+        os.close(fd)
+    points = [TierPoint(*p) for p in TIER_POINT.iter_unpack(out.raw)]
+    return [points[i * npoints:(i + 1) * npoints]
+            for i in range(len(minors))]
+
+
+def stub_bus(prefix="SMBus stub driver"):
+    """Number of the i2c-stub (or other named) adapter, or None."""
+    for name in pathlib.Path("/sys/bus/i2c/devices").glob("i2c-*/name"):
+        if name.read_text().startswith(prefix):
+            return int(name.parent.name.split("-")[1])
+    return None
+
+
+@contextlib.contextmanager
+def loaded_sensor(bus, initial=25.0, **params):
+    """Load the module with params and bind one sensor on the stub bus."""
+    sensor = Sensor(bus)
+    sensor.set_temp(initial)
+    run("insmod", str(KO), *(f"{k}={v}" for k, v in params.items()))
+    adapter = pathlib.Path(f"/sys/bus/i2c/devices/i2c-{bus}")
+    try:
+        (adapter / "new_device").write_text(f"mcp9808 {ADDR:#x}")
+        deadline = time.monotonic() + 2
+        while not os.path.exists(DEV) and time.monotonic() < deadline:
+            time.sleep(0.01)
+        assert os.path.exists(DEV), "device node did not appear"
+        yield sensor
+    finally:
+        with contextlib.suppress(OSError):
+            (adapter / "delete_device").write_text(f"{ADDR:#x}")
+        run("rmmod", "mcp9808")
+
+
+@contextlib.contextmanager
+def second_sensor(bus, initial=25.0):
+    """Bind a second sensor at ADDR2 next to a loaded one."""
+    sensor = Sensor(bus, ADDR2, f"{DEV}-1")
+    sensor.set_temp(initial)
+    adapter = pathlib.Path(f"/sys/bus/i2c/devices/i2c-{bus}")
+    try:
+        (adapter / "new_device").write_text(f"mcp9808 {ADDR2:#x}")
+        deadline = time.monotonic() + 2
+        while not os.path.exists(sensor.dev) and time.monotonic() < deadline:
+            time.sleep(0.01)
+        assert os.path.exists(sensor.dev), "second device node did not appear"
+        yield sensor
+    finally:
+        with contextlib.suppress(OSError):
+            (adapter / "delete_device").write_text(f"{ADDR2:#x}")
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, len(values) * pct // 100)]
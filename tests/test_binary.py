@@ -0,0 +1,78 @@
+import errno
+import os
+import time
+
+import pytest
+
+from mcp9808_helpers import (FLAG_UPPER, SAMPLE, read_samples, set_mode,
+                             temp_to_raw)
+
+
+def test_sample_record(sensor):
+    sensor.set_temp(-12.75, flags=FLAG_UPPER)
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        s = read_samples(fd)[0]
+        assert s.temp == -127500
+        assert s.raw == temp_to_raw(-12.75, FLAG_UPPER)
+        assert s.flags == FLAG_UPPER
+        assert 0 < time.clock_gettime_ns(time.CLOCK_MONOTONIC) - s.ts < 10**9
+    finally:
+        os.close(fd)
+
+
+def test_sequence_increases(sensor):
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        seqs = [s[0] for s in read_samples(fd, 1) + read_samples(fd, 1)
+                + read_samples(fd, 1)]
+        assert seqs == sorted(seqs) and len(set(seqs)) == 3
+    finally:
+        os.close(fd)
+
+
+def test_whole_records_only(sensor):
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        with pytest.raises(OSError) as e:
+            os.read(fd, SAMPLE.size - 1)
+        assert e.value.errno == errno.EINVAL
+        time.sleep(0.5)
+        data = os.read(fd, SAMPLE.size * 3 + 5)
+        assert len(data) % SAMPLE.size == 0
+    finally:
+        os.close(fd)
+
+
+def test_nonblocking_empty(sensor):
+    fd = sensor.open_stream(nonblock=True)
+    try:
+        with pytest.raises(BlockingIOError):
+            os.read(fd, SAMPLE.size)
+    finally:
+        os.close(fd)
+
+
+def test_bad_mode(sensor):
+    fd = os.open(sensor.dev, os.O_RDONLY)
+    try:
+        with pytest.raises(OSError) as e:
+            set_mode(fd, 7)
+        assert e.value.errno == errno.EINVAL
+    finally:
+        os.close(fd)
+
+
+def test_decimation(sensor):
+    fast = sensor.open_stream(rate_mhz=8000)
+    slow = sensor.open_stream(rate_mhz=2000, nonblock=True)
+    try:
+        time.sleep(2.2)
+        got = read_samples(slow, 64)
+        # 2 Hz over ~2.2 s, whatever the shared schedule runs at
+        assert 4 <= len(got) <= 6
+        gaps = [b[1] - a[1] for a, b in zip(got, got[1:])]
+        assert all(gap > 0.35e9 for gap in gaps)
+    finally:
+        os.close(fast)
+        os.close(slow)
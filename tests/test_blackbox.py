@@ -0,0 +1,90 @@
+"""Persistent black box.
+
+Needs a reserved RAM region, e.g. boot the VM with memmap=1M$0x7f000000
+and set MCP9808_BLACKBOX=0x7f000000,0x100000.  A module reload stands in
+for the reboot: the region is left as is and recovered on load.
+"""
+
+import os
+import time
+
+import pytest
+
+from mcp9808_helpers import BLACKBOX, DEV_BLACKBOX, loaded_sensor, \
+    percentile, read_samples
+
+REGION = os.environ.get("MCP9808_BLACKBOX")
+PARAM = "/sys/module/mcp9808/parameters/blackbox_enable"
+
+
+@pytest.fixture
+def bb_params(i2c_stub):
+    if not REGION:
+        pytest.skip("set MCP9808_BLACKBOX=addr,size of a reserved region")
+    addr, size = REGION.split(",")
+    return {"blackbox_addr": addr, "blackbox_size": size}
+
+
+def read_blackbox():
+    with open(DEV_BLACKBOX, "rb") as f:
+        data = f.read()
+    return [BLACKBOX.unpack_from(data, off)
+            for off in range(0, len(data), BLACKBOX.size)]
+
+
+def test_recovered_after_reload(i2c_stub, bb_params):
+    with loaded_sensor(i2c_stub, **bb_params) as sensor:
+        for celsius in (20.0, -5.5, 71.25):
+            sensor.set_temp(celsius)
+            sensor.read_text()
+        written = time.time_ns()
+
+    with loaded_sensor(i2c_stub, **bb_params):
+        recs = read_blackbox()
+    assert [r[1] for r in recs[-3:]] == [200000, -55000, 712500]
+    assert all(r[3] == 0 for r in recs[-3:])
+    # tick resolution is ~8 ms; allow for it and the reload
+    assert abs(recs[-1][0] - written) < 2 * 10**9
+
+
+
+def test_previous_boot_only(i2c_stub, bb_params):
+    with loaded_sensor(i2c_stub, **bb_params) as sensor:
+        sensor.set_temp(33.5)
+        sensor.read_text()
+    with loaded_sensor(i2c_stub, **bb_params) as sensor:
+        sensor.set_temp(-12.25)
+        sensor.read_text()
+
+    with loaded_sensor(i2c_stub, **bb_params):
+        recs = read_blackbox()
+    temps = [r[1] for r in recs]
+    assert -122500 in temps and 335000 not in temps
+    assert [r[0] for r in recs] == sorted(r[0] for r in recs)
+
+
+@pytest.mark.perf
+def test_recording_overhead(i2c_stub, bb_params, metrics):
+    def delivery_lag(sensor):
+        fd = sensor.open_stream(rate_mhz=8000)
+        try:
+            lag = []
+            for _ in range(40):
+                ts = read_samples(fd)[0][1]
+                lag.append(time.clock_gettime_ns(time.CLOCK_MONOTONIC) - ts)
+            return lag
+        finally:
+            os.close(fd)
+
+    with loaded_sensor(i2c_stub, **bb_params) as sensor:
+        with open(PARAM, "w") as f:
+            f.write("0")
+        off = delivery_lag(sensor)
+        with open(PARAM, "w") as f:
+            f.write("1")
+        on = delivery_lag(sensor)
+
+    # Reported only: wakeup jitter on a 130 ms sample period is far larger
+    # than one 8-byte store, so no bound here could catch a regression.
+    metrics["blackbox_off_p50_us"] = percentile(off, 50) / 1e3
+    metrics["blackbox_on_p50_us"] = percentile(on, 50) / 1e3
@@ -0,0 +1,43 @@
+import errno
+import fcntl
+import os
+
+import pytest
+
+from mcp9808_helpers import IOC_GET_EVENT
+
+
+@pytest.mark.parametrize("name", ["temp_upper", "temp_lower", "temp_crit"])
+@pytest.mark.parametrize("value,expect", [
+    (300000, 300000),           # 30 °C
+    (-52500, -52500),           # -5.25 °C
+    (301000, 300000),           # rounded to 0.25 °C
+    (301300, 302500),
+    (2000000, 1250000),         # clamped to the 125 °C range
+    (-500000, -400000),
+])
+def test_limit_roundtrip(sensor, name, value, expect):
+    sensor.set_attr(name, value)
+    assert int(sensor.attr(name)) == expect
+
+
+def test_limit_rejects_garbage(sensor):
+    with pytest.raises(OSError) as e:
+        sensor.set_attr("temp_upper", "warm")
+    assert e.value.errno == errno.EINVAL
+
+
+@pytest.mark.parametrize("name", ["bus_reads", "batched_reads", "alerts",
+                                  "sample_overruns", "event_overruns"])
+def test_stats_present(sensor, name):
+    assert sensor.stat(name) >= 0
+
+
+def test_unknown_ioctl(sensor):
+    fd = os.open(sensor.dev, os.O_RDONLY)
+    try:
+        with pytest.raises(OSError) as e:
+            fcntl.ioctl(fd, IOC_GET_EVENT + 0x40, bytes(32))
+        assert e.value.errno == errno.ENOTTY
+    finally:
+        os.close(fd)
@@ -0,0 +1,75 @@
+import os
+import time
+
+import pytest
+
+from mcp9808_helpers import EVENT_FORECAST, FLAG_UPPER, drain_events, \
+    read_samples
+
+
+def stream(sensor, temps, dwell=0.3):
+    """Step the emulated temperature through temps, collecting samples."""
+    fd = sensor.open_stream(rate_mhz=8000, nonblock=True)
+    got = []
+    try:
+        for celsius in temps:
+            sensor.set_temp(celsius)
+            time.sleep(dwell)
+            got += read_samples(fd, 64)
+    finally:
+        os.close(fd)
+    return got
+
+
+def test_steady_temperature(sensor):
+    got = stream(sensor, [25.0] * 5)
+    last = got[-1]
+    assert abs(last.forecast - 250000) <= 625
+    assert last.upper_eta_ms == -1 or last.upper_eta_ms > 10**6
+    assert last.reserved == 0
+
+
+def test_rising_trend(sensor):
+    sensor.set_attr("temp_upper", 400000)
+    got = stream(sensor, [20.0 + i for i in range(12)])
+    last = got[-1]
+    # roughly 1 °C per 0.43 s: forecast well above current, upper ahead
+    assert last.forecast > last.temp
+    assert 0 < last.upper_eta_ms < 60000
+
+
+def test_at_limit_eta_zero(sensor):
+    sensor.set_attr("temp_upper", 300000)
+    got = stream(sensor, [35.0] * 3)
+    assert got[-1].upper_eta_ms == 0
+
+
+def test_forecast_clamped(sensor):
+    sensor.set_attr("forecast_horizon_ms", 3600000)
+    got = stream(sensor, [20.0 + 10 * i for i in range(8)])
+    # an hour of a steep ramp lands far past 125 °C; the range caps it
+    assert max(s.forecast for s in got) == 1250000
+    assert all(s.forecast >= -400000 for s in got)
+
+
+def test_early_warning_event(sensor):
+    sensor.set_attr("temp_upper", 400000)
+    sensor.set_attr("forecast_horizon_ms", 60000)
+    fd = os.open(sensor.dev, os.O_RDONLY | os.O_NONBLOCK)
+    try:
+        stream(sensor, [20.0 + i for i in range(12)])
+        events = drain_events(fd)
+    finally:
+        os.close(fd)
+    warnings = [e for e in events
+                if e[3] == EVENT_FORECAST and e[4] == FLAG_UPPER]
+    # edge-triggered: one warning for the whole approach
+    assert len(warnings) == 1
+    assert warnings[0][2] > 200000
+
+
+def test_horizon_bounds(sensor):
+    with pytest.raises(OSError):
+        sensor.set_attr("forecast_horizon_ms", 3600001)
+    sensor.set_attr("forecast_horizon_ms", 0)
+    assert sensor.attr("forecast_horizon_ms") == "0"
@@ -0,0 +1,58 @@
+import errno
+import os
+
+import pytest
+
+from mcp9808_helpers import NO_VALUE, RESAMPLE_LINEAR, RESAMPLE_NEAREST, \
+    history, read_samples
+
+
+def two_samples(sensor, first, second):
+    """Two consecutive pool samples across a step from first to second °C."""
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        sensor.set_temp(first)
+        got = read_samples(fd, 8)
+        sensor.set_temp(second)
+        while got[-1].temp != round(second * 10000):
+            got += read_samples(fd, 8)
+    finally:
+        os.close(fd)
+    a, b = got[-2], got[-1]
+    assert b.seq == a.seq + 1 and a.temp == round(first * 10000)
+    return a, b
+
+
+def test_nearest_and_linear(sensor):
+    a, b = two_samples(sensor, 20.0, 30.0)
+    mid = (a.ts + b.ts) // 2
+    near = history([0], mid - 1, 2, 2, RESAMPLE_NEAREST)[0]
+    lin = history([0], mid, 1, 1, RESAMPLE_LINEAR)[0][0]
+    expected = a.temp + (b.temp - a.temp) * (mid - a.ts) // (b.ts - a.ts)
+    assert near == [a.temp, b.temp]
+    assert abs(lin - expected) <= 1
+
+
+def test_grid_outside_history(sensor):
+    a, b = two_samples(sensor, 22.0, 23.0)
+    rows = history([0], b.ts + 10**9, 10**6, 4)
+    assert rows == [[NO_VALUE] * 4]
+
+
+def test_rows_per_sensor(sensor):
+    a, b = two_samples(sensor, 24.0, 26.0)
+    rows = history([0, 0], b.ts, 1, 1)
+    assert rows == [[b.temp], [b.temp]]
+
+
+def test_errors(sensor):
+    sensor.read_text()
+    with pytest.raises(OSError) as exc:
+        history([1], 0, 1, 1)
+    assert exc.value.errno == errno.ENODEV
+    with pytest.raises(OSError) as exc:
+        history([0], 0, 0, 1)
+    assert exc.value.errno == errno.EINVAL
+    with pytest.raises(OSError) as exc:
+        history([0], 0, 1, 65537)
+    assert exc.value.errno == errno.EINVAL
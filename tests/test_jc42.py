@@ -0,0 +1,165 @@
+"""Compare this driver with the in-tree jc42 hwmon driver.
+
+Both drivers are bound in turn to the same i2c-stub chip and read the
+same temperature register.  Bus transactions are counted with the smbus
+trace events, so the figures include reads the drivers do on their own.
+"""
+
+import contextlib
+import os
+import pathlib
+import subprocess
+import threading
+import time
+
+import pytest
+
+from mcp9808_helpers import ADDR, Sensor, loaded_sensor, percentile, run
+
+pytestmark = pytest.mark.perf
+
+TRACING = pathlib.Path("/sys/kernel/tracing")
+READS = 2000
+READERS = 16
+CONCURRENT_S = 2.0
+
+
+class BusTrace:
+    """Counts SMBus transfers on one adapter through tracefs."""
+
+    def __init__(self, bus):
+        self.event = TRACING / "events" / "smbus" / "smbus_result"
+        if not self.event.exists():
+            pytest.skip("smbus trace events unavailable")
+        (self.event / "filter").write_text(f"adapter_nr == {bus}")
+        (self.event / "enable").write_text("1")
+
+    def close(self):
+        (self.event / "enable").write_text("0")
+        (self.event / "filter").write_text("0")
+
+    def count(self):
+        """Transfers since the last call."""
+        trace = TRACING / "trace"
+        lines = [l for l in trace.read_text().splitlines()
+                 if not l.startswith("#")]
+        trace.write_text("")
+        return len(lines)
+
+
+@pytest.fixture
+def bus_trace(i2c_stub):
+    trace = BusTrace(i2c_stub)
+    yield trace
+    trace.close()
+
+
+@contextlib.contextmanager
+def bound_jc42(bus):
+    """jc42 on the stub chip; yields the path of temp1_input."""
+    sensor = Sensor(bus)
+    sensor.set_reg(0x06, 0x0054)       # manufacturer: Microchip
+    sensor.set_reg(0x07, 0x0400)       # device: MCP9808
+    sensor.set_temp(25.0)
+    try:
+        run("modprobe", "jc42")
+    except (OSError, subprocess.CalledProcessError) as e:
+        pytest.skip(f"jc42 unavailable: {e}")
+    adapter = pathlib.Path(f"/sys/bus/i2c/devices/i2c-{bus}")
+    (adapter / "new_device").write_text(f"jc42 {ADDR:#x}")
+    try:
+        hwmon = sensor.sysfs / "hwmon"
+        deadline = time.monotonic() + 2
+        while not list(hwmon.glob("hwmon*/temp1_input")) and \
+                time.monotonic() < deadline:
+            time.sleep(0.01)
+        inputs = list(hwmon.glob("hwmon*/temp1_input"))
+        assert inputs, "jc42 did not bind"
+        yield str(inputs[0])
+    finally:
+        (adapter / "delete_device").write_text(f"{ADDR:#x}")
+        run("rmmod", "jc42")
+
+
+def busy_jiffies():
+    """System-wide non-idle CPU time, in clock ticks."""
+    with open("/proc/stat") as f:
+        fields = [int(v) for v in f.readline().split()[1:]]
+    return sum(fields) - fields[3] - fields[4]     # minus idle, iowait
+
+
+def measure(path, trace):
+    """Back-to-back pread()s: latency, CPU and bus transfers per read."""
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        lat = []
+        trace.count()
+        cpu0, sys0 = os.times(), busy_jiffies()
+        for _ in range(READS):
+            t0 = time.perf_counter_ns()
+            os.pread(fd, 32, 0)
+            lat.append(time.perf_counter_ns() - t0)
+        cpu1, sys1 = os.times(), busy_jiffies()
+        bus = trace.count()
+    finally:
+        os.close(fd)
+    tick = os.sysconf("SC_CLK_TCK")
+    return {
+        "read_p50_us": percentile(lat, 50) / 1e3,
+        "read_p99_us": percentile(lat, 99) / 1e3,
+        "cpu_us_per_read": (cpu1.user + cpu1.system - cpu0.user -
+                            cpu0.system) * 1e6 / READS,
+        "sys_cpu_us_per_read": (sys1 - sys0) / tick * 1e6 / READS,
+        "bus_per_read": bus / READS,
+    }
+
+
+def concurrent(path, trace):
+    """READERS threads reading as fast as they can."""
+    lats = [[] for _ in range(READERS)]
+    stop = time.monotonic() + CONCURRENT_S
+
+    def reader(out):
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            while time.monotonic() < stop:
+                t0 = time.perf_counter_ns()
+                os.pread(fd, 32, 0)
+                out.append(time.perf_counter_ns() - t0)
+        finally:
+            os.close(fd)
+
+    trace.count()
+    threads = [threading.Thread(target=reader, args=(l,)) for l in lats]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    bus = trace.count()
+    lat = [v for l in lats for v in l]
+    return {
+        "concurrent_reads_per_s": len(lat) / CONCURRENT_S,
+        "concurrent_p99_us": percentile(lat, 99) / 1e3,
+        "concurrent_bus_per_s": bus / CONCURRENT_S,
+    }
+
+
+def record(metrics, driver, figures):
+    for name, value in figures.items():
+        metrics[f"{driver}_{name}"] = value
+
+
+def test_mcp9808_vs_jc42(i2c_stub, bus_trace, metrics):
+    with loaded_sensor(i2c_stub) as sensor:
+        ours = measure(sensor.dev, bus_trace)
+        ours.update(concurrent(sensor.dev, bus_trace))
+    with bound_jc42(i2c_stub) as temp1_input:
+        theirs = measure(temp1_input, bus_trace)
+        theirs.update(concurrent(temp1_input, bus_trace))
+    record(metrics, "mcp9808", ours)
+    record(metrics, "jc42", theirs)
+
+    # reads inside one conversion are served without touching the bus
+    assert ours["bus_per_read"] < 0.5
+    # bus traffic under load is bounded by the conversion time
+    assert ours["concurrent_bus_per_s"] <= 1 / 0.13 + 2
@@ -0,0 +1,64 @@
+import mmap
+import os
+import time
+
+import pytest
+
+from mcp9808_helpers import DEV_ALL, LATEST, LATEST_ENTRIES, FLAG_LOWER, \
+    read_samples, temp_to_raw
+
+
+def read_entry(page, minor):
+    while True:
+        ts, temp, raw, flags, seq, _ = LATEST.unpack_from(page,
+                                                          minor * LATEST.size)
+        if seq % 2 == 0 and \
+                LATEST.unpack_from(page, minor * LATEST.size)[4] == seq:
+            return ts, temp, raw, flags
+
+
+@pytest.fixture
+def page(sensor):
+    fd = os.open(DEV_ALL, os.O_RDONLY)
+    m = mmap.mmap(fd, mmap.PAGESIZE, mmap.MAP_SHARED, mmap.PROT_READ)
+    os.close(fd)
+    yield m
+    m.close()
+
+
+def test_entry_follows_samples(sensor, page):
+    sensor.set_temp(-3.5, flags=FLAG_LOWER)
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        s = read_samples(fd)[0]
+    finally:
+        os.close(fd)
+    entry = read_entry(page, 0)
+    assert entry[0] >= s.ts
+    assert entry[1:] == (s.temp, s.raw, s.flags)
+    assert entry[1:] == (-35000, temp_to_raw(-3.5, FLAG_LOWER), FLAG_LOWER)
+
+
+def test_unbound_slots_empty(sensor, page):
+    sensor.read_text()
+    assert all(read_entry(page, m)[0] == 0
+               for m in range(1, LATEST_ENTRIES))
+
+
+def test_read_only(sensor):
+    fd = os.open(DEV_ALL, os.O_RDWR)
+    try:
+        with pytest.raises(OSError):
+            mmap.mmap(fd, mmap.PAGESIZE, mmap.MAP_SHARED,
+                      mmap.PROT_READ | mmap.PROT_WRITE)
+    finally:
+        os.close(fd)
+
+
+@pytest.mark.perf
+def test_no_syscall_per_read(sensor, page, metrics):
+    sensor.read_text()
+    t0 = time.perf_counter_ns()
+    for _ in range(10000):
+        read_entry(page, 0)
+    metrics["latest_entry_read_ns"] = (time.perf_counter_ns() - t0) / 10000
@@ -0,0 +1,118 @@
+"""Two sensors on one adapter: /dev/mcp9808 and /dev/mcp9808-1.
+
+i2c-stub only speaks SMBus, so most of these exercise the shared
+per-adapter schedule through its SMBus fallback.  The batched
+i2c_transfer() path runs on tests/i2c-plain-stub (make test-modules),
+which emulates the same chips over plain I2C.
+"""
+
+import errno
+import mmap
+import os
+import time
+
+import pytest
+
+from mcp9808_helpers import CONV_S, DEV_ALL, LATEST, loaded_sensor, \
+    parse_text, read_samples, second_sensor
+
+
+@pytest.fixture
+def pair(sensor, i2c_stub):
+    with second_sensor(i2c_stub, initial=-5.0) as other:
+        yield sensor, other
+
+
+def test_second_node_reads_its_chip(pair):
+    first, second = pair
+    first.set_temp(25.0)
+    assert parse_text(first.read_text()) == 25.0
+    assert parse_text(second.read_text()) == -5.0
+
+
+def test_shared_schedule(pair):
+    first, second = pair
+    fds = [s.open_stream(rate_mhz=8000, nonblock=True) for s in pair]
+    try:
+        before = [s.stat("bus_reads") for s in pair]
+        t0 = time.monotonic()
+        time.sleep(2)
+        elapsed = time.monotonic() - t0
+        reads = [s.stat("bus_reads") - b for s, b in zip(pair, before)]
+        got = [read_samples(fd, 64) for fd in fds]
+    finally:
+        for fd in fds:
+            os.close(fd)
+    for n in reads:
+        assert 0 < n / elapsed <= 1 / CONV_S + 1
+    assert {s.temp for s in got[0]} == {250000}
+    assert {s.temp for s in got[1]} == {-50000}
+    # SMBus-only adapter: every read took the fallback
+    assert first.stat("batched_reads") == 0
+    assert second.stat("batched_reads") == 0
+
+
+def test_batched_reads(plain_i2c):
+    with loaded_sensor(plain_i2c) as first, \
+            second_sensor(plain_i2c, initial=-5.0) as second:
+        pair = (first, second)
+        fds = [s.open_stream(rate_mhz=8000, nonblock=True) for s in pair]
+        try:
+            before = [s.stat("batched_reads") for s in pair]
+            time.sleep(2)
+            batched = [s.stat("batched_reads") - b
+                       for s, b in zip(pair, before)]
+            got = [read_samples(fd, 64) for fd in fds]
+        finally:
+            for fd in fds:
+                os.close(fd)
+    # both sensors read in one transfer per tick, each with its own value
+    assert all(n > 5 for n in batched)
+    assert {s.temp for s in got[0]} == {250000}
+    assert {s.temp for s in got[1]} == {-50000}
+
+
+def test_latest_slot_follows_minor(sensor, i2c_stub):
+    fd = os.open(DEV_ALL, os.O_RDONLY)
+    page = mmap.mmap(fd, mmap.PAGESIZE, mmap.MAP_SHARED, mmap.PROT_READ)
+    os.close(fd)
+    try:
+        with second_sensor(i2c_stub, initial=-5.0) as second:
+            second.read_text()
+            ts, temp = LATEST.unpack_from(page, LATEST.size)[:2]
+            assert ts and temp == -50000
+        # unbinding clears the slot
+        assert LATEST.unpack_from(page, LATEST.size)[0] == 0
+    finally:
+        page.close()
+
+
+def test_alert_param_goes_to_first_sensor(alert_sensor, i2c_stub):
+    sensor, pull = alert_sensor
+    with second_sensor(i2c_stub) as other:
+        pull.write_text("pull-down")
+        time.sleep(0.2)
+        pull.write_text("pull-up")
+        assert sensor.stat("alerts") == 1
+        assert other.stat("alerts") == 0
+
+
+def test_open_file_survives_unbind(sensor, i2c_stub):
+    with second_sensor(i2c_stub) as other:
+        text = os.open(other.dev, os.O_RDONLY)
+        stream = other.open_stream(rate_mhz=8000)
+        read_samples(stream)
+    # unbound with both files open: they fail cleanly instead of
+    # touching the freed client, and closing them frees the device
+    try:
+        with pytest.raises(OSError) as exc:
+            os.read(text, 32)
+        assert exc.value.errno == errno.ENODEV
+        with pytest.raises(OSError) as exc:
+            for _ in range(8):      # samples still pooled are read first
+                read_samples(stream, 64)
+        assert exc.value.errno == errno.ENODEV
+    finally:
+        os.close(text)
+        os.close(stream)
+    assert parse_text(sensor.read_text()) is not None
@@ -0,0 +1,60 @@
+import os
+import statistics
+import time
+
+import pytest
+
+from mcp9808_helpers import CONV_S, percentile, read_samples
+
+pytestmark = pytest.mark.perf
+
+
+def test_text_read_latency(sensor, metrics):
+    samples = []
+    before = sensor.stat("bus_reads")
+    for _ in range(200):
+        t0 = time.perf_counter_ns()
+        sensor.read_text()
+        samples.append(time.perf_counter_ns() - t0)
+    metrics["text_read_p50_us"] = percentile(samples, 50) / 1e3
+    metrics["text_read_p99_us"] = percentile(samples, 99) / 1e3
+    metrics["text_bus_reads_per_read"] = \
+        (sensor.stat("bus_reads") - before) / len(samples)
+
+
+def test_stream_interval_and_latency(sensor, metrics):
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        got, lag = [], []
+        for _ in range(20):
+            rec = read_samples(fd)[0]
+            lag.append(time.clock_gettime_ns(time.CLOCK_MONOTONIC) - rec[1])
+            got.append(rec)
+    finally:
+        os.close(fd)
+    intervals = [b[1] - a[1] for a, b in zip(got, got[1:])]
+    metrics["stream_interval_ms"] = statistics.mean(intervals) / 1e6
+    metrics["stream_delivery_p50_us"] = percentile(lag, 50) / 1e3
+    metrics["stream_delivery_p99_us"] = percentile(lag, 99) / 1e3
+    # 8 Hz is clamped to one conversion
+    assert metrics["stream_interval_ms"] >= CONV_S * 1e3 * 0.9
+
+
+def test_shared_schedule_bus_traffic(sensor, metrics):
+    rates = (1000, 4000, 8000)
+    fds = [sensor.open_stream(rate_mhz=r, nonblock=True) for r in rates]
+    try:
+        before = sensor.stat("bus_reads")
+        t0 = time.monotonic()
+        time.sleep(3)
+        elapsed = time.monotonic() - t0
+        reads = sensor.stat("bus_reads") - before
+        delivered = [len(read_samples(fd, 64)) for fd in fds]
+    finally:
+        for fd in fds:
+            os.close(fd)
+    metrics["shared_bus_reads_per_s"] = reads / elapsed
+    for rate, n in zip(rates, delivered):
+        metrics[f"shared_delivered_{rate // 1000}hz_per_s"] = n / elapsed
+    # traffic follows the fastest subscriber, not the sum
+    assert reads / elapsed <= 1 / CONV_S + 1
@@ -0,0 +1,58 @@
+import os
+import select
+import time
+
+from mcp9808_helpers import EVENT_ALERT, FLAG_UPPER, get_event
+
+import pytest
+
+
+def test_text_always_readable(sensor):
+    fd = os.open(sensor.dev, os.O_RDONLY)
+    try:
+        p = select.poll()
+        p.register(fd, select.POLLIN | select.POLLPRI)
+        assert p.poll(0) == [(fd, select.POLLIN)]
+    finally:
+        os.close(fd)
+
+
+def test_binary_readable_on_sample(sensor):
+    fd = sensor.open_stream(nonblock=True)
+    try:
+        p = select.poll()
+        p.register(fd, select.POLLIN)
+        assert p.poll(0) == []
+        sensor.read_text()          # a read by anyone publishes a sample
+        assert p.poll(1000) == [(fd, select.POLLIN)]
+    finally:
+        os.close(fd)
+
+
+def test_no_event_without_alert(sensor):
+    fd = os.open(sensor.dev, os.O_RDONLY | os.O_NONBLOCK)
+    try:
+        with pytest.raises(BlockingIOError):
+            get_event(fd)
+    finally:
+        os.close(fd)
+
+
+def test_alert_event(alert_sensor):
+    sensor, pull = alert_sensor
+    sensor.set_temp(40.0, flags=FLAG_UPPER)
+    fd = os.open(sensor.dev, os.O_RDONLY | os.O_NONBLOCK)
+    try:
+        p = select.poll()
+        p.register(fd, select.POLLPRI)
+        pull.write_text("pull-down")
+        assert p.poll(1000)
+        ev = get_event(fd)
+        assert ev.type == EVENT_ALERT
+        assert ev.temp == 400000
+        assert ev.flags == FLAG_UPPER
+        assert ev.count == 1
+        assert sensor.stat("alerts") == 1
+    finally:
+        pull.write_text("pull-up")
+        os.close(fd)
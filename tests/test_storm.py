@@ -0,0 +1,70 @@
+import os
+import pathlib
+import time
+
+from mcp9808_helpers import EVENT_ALERT, EVENT_STORM, FLAG_UPPER, \
+    drain_events
+
+PARAM = pathlib.Path("/sys/module/mcp9808/parameters/alert_storm_limit")
+CONFIG_REG = 0x01
+ALERT_MOD = 1 << 0
+HYST = 3 << 9
+LIMIT = 5
+
+
+def fire(pull, edges):
+    for _ in range(edges):
+        pull.write_text("pull-down")
+        time.sleep(0.01)
+        pull.write_text("pull-up")
+        time.sleep(0.01)
+
+
+def test_storm_is_coalesced(alert_sensor):
+    sensor, pull = alert_sensor
+    PARAM.write_text(str(LIMIT))
+    sensor.set_temp(40.0, flags=FLAG_UPPER)
+    fd = os.open(sensor.dev, os.O_RDONLY | os.O_NONBLOCK)
+    try:
+        fire(pull, 4 * LIMIT)
+        # riding out the storm: comparator mode, widest hysteresis
+        config = sensor.get_reg(CONFIG_REG)
+        assert not config & ALERT_MOD
+        assert config & HYST == HYST
+
+        # one period of 1 s, then 2 s more as it was still storming
+        deadline = time.monotonic() + 10
+        while time.monotonic() < deadline and \
+                not sensor.get_reg(CONFIG_REG) & ALERT_MOD:
+            time.sleep(0.1)
+        events = drain_events(fd)
+    finally:
+        os.close(fd)
+
+    alerts = [e for e in events if e.type == EVENT_ALERT]
+    storms = [e for e in events if e.type == EVENT_STORM]
+    # the alert that tripped the limit is still reported on its own
+    assert len(alerts) == LIMIT + 1
+    assert storms
+    assert storms[0].temp == 400000
+    assert sensor.stat("alert_storms") == 1
+    assert sensor.stat("alerts_coalesced") == sum(e.count for e in storms)
+    assert sensor.stat("alerts_coalesced") <= 3 * LIMIT
+    config = sensor.get_reg(CONFIG_REG)
+    assert config & ALERT_MOD and not config & HYST
+
+
+def test_slow_alerts_not_coalesced(alert_sensor):
+    sensor, pull = alert_sensor
+    PARAM.write_text(str(LIMIT))
+    sensor.set_temp(40.0, flags=FLAG_UPPER)
+    fd = os.open(sensor.dev, os.O_RDONLY | os.O_NONBLOCK)
+    try:
+        for _ in range(3):
+            fire(pull, LIMIT - 1)
+            time.sleep(1.1)
+        events = drain_events(fd)
+    finally:
+        os.close(fd)
+    assert [e.type for e in events] == [EVENT_ALERT] * (3 * (LIMIT - 1))
+    assert sensor.stat("alert_storms") == 0
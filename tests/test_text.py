@@ -0,0 +1,44 @@
+import pytest
+
+from mcp9808_helpers import FLAG_CRIT, FLAG_UPPER, parse_text
+
+
+@pytest.mark.parametrize("celsius", [25.0, 0.0, 0.0625, 23.125, 124.9375,
+                                     -0.0625, -0.5, -10.25, -40.0])
+def test_temperature(sensor, celsius):
+    sensor.set_temp(celsius)
+    assert parse_text(sensor.read_text()) == celsius
+
+
+def test_format(sensor):
+    sensor.set_temp(-0.5)
+    assert sensor.read_text() == "-0.5000\n"
+    sensor.set_temp(21.0625)
+    assert sensor.read_text() == "21.0625\n"
+
+
+def test_flags_ignored(sensor):
+    sensor.set_temp(30.0, flags=FLAG_CRIT | FLAG_UPPER)
+    assert parse_text(sensor.read_text()) == 30.0
+
+
+def test_eof_after_one_line(sensor):
+    with open(sensor.dev, "rb") as f:
+        line = f.read(64)
+        assert line.endswith(b"\n")
+        assert f.read(64) == b""
+
+
+def test_short_buffer(sensor):
+    sensor.set_temp(12.5)
+    with open(sensor.dev, "rb", buffering=0) as f:
+        assert f.read(3) == b"12."
+
+
+def test_repeat_reads_cached(sensor):
+    sensor.read_text()
+    before = sensor.stat("bus_reads")
+    for _ in range(5):
+        sensor.read_text()
+    # all within one conversion time of the first read
+    assert sensor.stat("bus_reads") - before <= 1
@@ -0,0 +1,90 @@
+import errno
+import os
+import select
+
+import pytest
+
+from mcp9808_helpers import EVENT_FALLING, EVENT_RISING, add_threshold, \
+    del_threshold, drain_events
+
+
+def crossings(fd):
+    return [(e[3], e[2]) for e in drain_events(fd)]
+
+
+@pytest.fixture
+def fds(sensor):
+    opened = [os.open(sensor.dev, os.O_RDONLY | os.O_NONBLOCK)
+              for _ in range(2)]
+    sensor.read_text()              # publish the starting sample
+    yield opened
+    for fd in opened:
+        os.close(fd)
+
+
+def test_rising_and_falling(sensor, fds):
+    a, b = fds
+    for t in (300000, 350000):
+        add_threshold(a, t)
+    add_threshold(b, 320000)
+
+    sensor.set_temp(36.0)
+    sensor.read_text()
+    assert crossings(a) == [(EVENT_RISING, 300000), (EVENT_RISING, 350000)]
+    assert crossings(b) == [(EVENT_RISING, 320000)]
+
+    sensor.set_temp(25.0)
+    sensor.read_text()
+    # nearest threshold first on the way down
+    assert crossings(a) == [(EVENT_FALLING, 350000), (EVENT_FALLING, 300000)]
+    assert crossings(b) == [(EVENT_FALLING, 320000)]
+
+
+def test_reaching_counts_going_up_only(sensor, fds):
+    a = fds[0]
+    add_threshold(a, 300000)
+    sensor.set_temp(30.0)
+    sensor.read_text()
+    assert crossings(a) == [(EVENT_RISING, 300000)]
+    sensor.set_temp(30.0625)
+    sensor.read_text()
+    assert crossings(a) == []
+    sensor.set_temp(29.9375)
+    sensor.read_text()
+    assert crossings(a) == [(EVENT_FALLING, 300000)]
+
+
+def test_poll_pri_and_seq_order(sensor, fds):
+    a = fds[0]
+    for t in (260000, 270000, 280000):
+        add_threshold(a, t)
+    p = select.poll()
+    p.register(a, select.POLLPRI)
+    assert p.poll(0) == []
+    sensor.set_temp(29.0)
+    sensor.read_text()
+    assert p.poll(0) == [(a, select.POLLPRI)]
+    seqs = [e[0] for e in drain_events(a)]
+    assert len(seqs) == 3 and seqs == sorted(seqs)
+
+
+def test_add_del_errors(fds):
+    a, b = fds
+    add_threshold(a, 300000)
+    add_threshold(b, 300000)        # same value on another file is fine
+    with pytest.raises(OSError) as exc:
+        add_threshold(a, 300000)
+    assert exc.value.errno == errno.EEXIST
+    del_threshold(a, 300000)
+    with pytest.raises(OSError) as exc:
+        del_threshold(a, 300000)
+    assert exc.value.errno == errno.ENOENT
+
+
+def test_deleted_threshold_is_silent(sensor, fds):
+    a = fds[0]
+    add_threshold(a, 300000)
+    del_threshold(a, 300000)
+    sensor.set_temp(35.0)
+    sensor.read_text()
+    assert crossings(a) == []
@@ -0,0 +1,111 @@
+import errno
+import os
+import time
+
+import pytest
+
+from mcp9808_helpers import NO_VALUE, RESAMPLE_NEAREST, TIER_MINUTE, \
+    TIER_SECOND, history, loaded_sensor, read_samples, tiers
+
+NS = 10**9
+
+
+def stream(sensor, temps):
+    """Sample at full rate while stepping through temps; return samples."""
+    fd = sensor.open_stream(rate_mhz=8000)
+    got = []
+    try:
+        for celsius in temps:
+            sensor.set_temp(celsius)
+            time.sleep(0.4)
+            got += read_samples(fd, 64)
+    finally:
+        os.close(fd)
+    return got
+
+
+def read_samples_once(sensor):
+    """Take one fresh sample; return its timestamp."""
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        return read_samples(fd)[0].ts
+    finally:
+        os.close(fd)
+
+
+def test_seconds_consolidate_samples(sensor):
+    got = stream(sensor, [20.0, 21.0, 22.0, 23.0, 24.0, 25.0])
+    first = got[0].ts // NS
+    points = tiers([0], TIER_SECOND, first * NS, got[-1].ts // NS - first)[0]
+    for p in points:
+        mine = [s.temp for s in got if s.ts // NS == p.start_ns // NS]
+        assert p.count == len(mine)
+        if mine:
+            assert (p.min, p.max) == (min(mine), max(mine))
+            # means are kept at the sensor's 1/16 °C (625) resolution
+            assert abs(p.mean - sum(mine) / len(mine)) <= 625 / 2
+
+
+def test_minute_folds_closed_seconds(sensor):
+    got = stream(sensor, [30.0, 31.0, 32.0])
+    minute = got[-1].ts // NS // 60
+    point = tiers([0], TIER_MINUTE, minute * 60 * NS, 1)[0][0]
+    seconds = [p for p in tiers([0], TIER_SECOND, minute * 60 * NS, 60)[0]
+               if p.count]
+    # the open second is folded into the minute only once it closes
+    open_start = max((p.start_ns for p in seconds), default=0)
+    assert point.start_ns == minute * 60 * NS
+    assert point.count == sum(p.count for p in seconds
+                              if p.start_ns < open_start)
+
+
+def test_empty_before_load(sensor):
+    sensor.read_text()
+    points = tiers([0], TIER_SECOND, NS, 4)[0]
+    assert all(p.count == 0 for p in points)
+    assert [p.start_ns for p in points] == [NS, 2 * NS, 3 * NS, 4 * NS]
+
+
+def test_skipped_seconds_read_empty(i2c_stub):
+    """Cells a lap old are stale, not cleared; they must read as empty."""
+    with loaded_sensor(i2c_stub, tier_points="4,4,4") as sensor:
+        for _ in range(4):          # fill every cell of the 4 s ring
+            sensor.read_text()
+            time.sleep(1)
+        time.sleep(3)
+        # the three seconds before this sample reuse the cells of the
+        # first three reads, one lap on, and got no samples of their own
+        last = read_samples_once(sensor)
+        points = tiers([0], TIER_SECOND, (last // NS - 3) * NS, 4)[0]
+    assert [p.count for p in points[:3]] == [0, 0, 0]
+    assert points[3].count >= 1
+
+
+def test_history_falls_back_to_tiers(sensor):
+    """Wraps the 256-record sample pool: takes about 40 s."""
+    fd = sensor.open_stream(rate_mhz=8000)
+    try:
+        sensor.set_temp(20.0)
+        old = read_samples(fd, 64)[0]
+        sensor.set_temp(21.0)
+        got = []
+        while len(got) < 300:
+            got += read_samples(fd, 64)
+    finally:
+        os.close(fd)
+    row = history([0], old.ts, NS // 10, 5, RESAMPLE_NEAREST)[0]
+    assert NO_VALUE not in row
+    assert all(200000 <= v <= 210000 for v in row)
+    # the tier walk stops at the end of the grid, not at the pool
+    assert 200000 <= history([0], old.ts, NS, 1, RESAMPLE_NEAREST)[0][0] \
+        <= 210000
+
+
+def test_errors(sensor):
+    sensor.read_text()
+    with pytest.raises(OSError) as exc:
+        tiers([1], TIER_SECOND, 0, 1)
+    assert exc.value.errno == errno.ENODEV
+    with pytest.raises(OSError) as exc:
+        tiers([0], 3, 0, 1)
+    assert exc.value.errno == errno.EINVAL
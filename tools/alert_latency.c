@@ -0,0 +1,163 @@
+/*
+ * alert_latency.c — Measure ALERT-to-userspace latency with a simulated
+ * ALERT line
+ *
+ * Drives a gpio-sim line wired to the driver's ALERT input (see
+ * alert_latency.sh), waits for the event on /dev/mcp9808 through each
+ * delivery path and reports latency percentiles:
+ *
+ *   assert->irq     line pulled low until the hard IRQ timestamp
+ *   irq->wakeup     hard IRQ timestamp until the waiter runs
+ *   assert->wakeup  end to end
+ *
+ * The driver delivers alerts through poll()/epoll() (POLLPRI) only;
+ * there is no eventfd, netlink or in-kernel notifier path to measure.
+ *
+ *   alert_latency -p /sys/.../sim_gpio0/pull [-d dev] [-n iterations]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+#include "mcp9808.h"
+
+enum { PATH_POLL, PATH_EPOLL, NR_PATHS };
+static const char *path_name[NR_PATHS] = { "poll", "epoll" };
+
+enum { M_ASSERT_IRQ, M_IRQ_WAKE, M_ASSERT_WAKE, NR_METRICS };
+static const char *metric_name[NR_METRICS] = {
+    "assert->irq", "irq->wakeup", "assert->wakeup",
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void set_pull(int fd, const char *val)
+{
+    if (pwrite(fd, val, strlen(val), 0) < 0) {
+        perror("pull");
+        exit(1);
+    }
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *path, const char *metric, int64_t *v, int n)
+{
+    qsort(v, n, sizeof(*v), cmp_i64);
+    printf("%-6s %-15s p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f us\n",
+           path, metric, v[n / 2] / 1e3, v[n * 90 / 100] / 1e3,
+           v[n * 99 / 100] / 1e3, v[n - 1] / 1e3);
+}
+
+/* Block until the next event arrives through the given path */
+static int wait_event(int path, int dev, int ep)
+{
+    struct pollfd pfd = { .fd = dev, .events = POLLPRI };
+    struct epoll_event ev;
+
+    switch (path) {
+    case PATH_POLL:
+        return poll(&pfd, 1, 1000);
+    case PATH_EPOLL:
+        return epoll_wait(ep, &ev, 1, 1000);
+    }
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dev_path = "/dev/mcp9808", *pull_path = NULL;
+    int iterations = 1000, opt, path, i, m, n;
+    struct epoll_event eev = { .events = EPOLLPRI };
+    struct mcp9808_event ev;
+    int64_t *lat[NR_METRICS], t_assert, t_wake;
+    int dev, pull, ep;
+
+    while ((opt = getopt(argc, argv, "d:p:n:")) != -1) {
+        switch (opt) {
+        case 'd': dev_path  = optarg; break;
+        case 'p': pull_path = optarg; break;
+        case 'n': iterations = atoi(optarg); break;
+        default:
+            pull_path = NULL;
+            optind = argc;
+        }
+    }
+    if (!pull_path || iterations < 1) {
+        fprintf(stderr, "usage: %s -p sim_gpio_pull [-d dev] "
+                        "[-n iterations]\n", argv[0]);
+        return 1;
+    }
+
+    dev  = open(dev_path, O_RDONLY | O_NONBLOCK);
+    pull = open(pull_path, O_WRONLY);
+    ep   = epoll_create1(0);
+    if (dev < 0 || pull < 0 || ep < 0) {
+        perror("open");
+        return 1;
+    }
+    eev.data.fd = dev;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, dev, &eev)) {
+        perror("epoll_ctl");
+        return 1;
+    }
+
+    for (m = 0; m < NR_METRICS; m++)
+        lat[m] = calloc(iterations, sizeof(int64_t));
+
+    for (path = 0; path < NR_PATHS; path++) {
+        n = 0;
+        for (i = 0; i < iterations; i++) {
+            /* release the line and drain anything left over */
+            set_pull(pull, "pull-up");
+            usleep(2000);
+            while (ioctl(dev, MCP9808_IOC_GET_EVENT, &ev) == 0)
+                ;
+
+            t_assert = now_ns();
+            set_pull(pull, "pull-down");
+            if (wait_event(path, dev, ep) <= 0) {
+                fprintf(stderr, "%s: no event\n", path_name[path]);
+                continue;
+            }
+            t_wake = now_ns();
+
+            if (ioctl(dev, MCP9808_IOC_GET_EVENT, &ev)) {
+                perror("MCP9808_IOC_GET_EVENT");
+                continue;
+            }
+            lat[M_ASSERT_IRQ][n]  = ev.timestamp_ns - t_assert;
+            lat[M_IRQ_WAKE][n]    = t_wake - ev.timestamp_ns;
+            lat[M_ASSERT_WAKE][n] = t_wake - t_assert;
+            n++;
+        }
+        if (!n)
+            continue;
+        for (m = 0; m < NR_METRICS; m++)
+            report(path_name[path], metric_name[m], lat[m], n);
+    }
+
+    set_pull(pull, "pull-up");
+    return 0;
+}
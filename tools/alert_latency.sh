@@ -0,0 +1,47 @@
+#!/bin/sh
+# Set up an emulated MCP9808 (i2c-stub) with its ALERT line on a gpio-sim
+# chip, then run alert_latency against it.  Needs root, configfs, the
+# i2c-stub and gpio-sim modules and a built mcp9808.ko.
+#
+#   tools/alert_latency.sh [iterations]
+set -e
+
+HERE=$(dirname "$0")
+KO=${KO:-$HERE/../mcp9808.ko}
+ADDR=0x18
+SIM=/sys/kernel/config/gpio-sim/mcp9808-bench
+LABEL=mcp9808-alert
+bus=
+
+# installed first: undoes whatever was set up when a later step fails
+cleanup() {
+    set +e
+    [ -n "$bus" ] && echo $ADDR > "$bus/delete_device"
+    rmmod mcp9808
+    if [ -d $SIM ]; then
+        echo 0 > $SIM/live
+        rmdir $SIM/bank0 $SIM
+    fi
+    rmmod gpio-sim i2c-stub
+} 2>/dev/null
+trap cleanup EXIT
+
+modprobe i2c-stub chip_addr=$ADDR
+modprobe gpio-sim
+
+mkdir -p $SIM/bank0
+echo 1 > $SIM/bank0/num_lines
+echo $LABEL > $SIM/bank0/label
+echo 1 > $SIM/live
+
+pull=/sys/devices/platform/$(cat $SIM/dev_name)/$(cat $SIM/bank0/chip_name)/sim_gpio0/pull
+echo pull-up > "$pull"
+
+# every sample is an alert here; keep storm mitigation from coalescing them
+insmod "$KO" alert_chip=$LABEL alert_line=0 alert_storm_limit=0
+
+bus=$(grep -l "SMBus stub driver" /sys/bus/i2c/devices/i2c-*/name | head -n1)
+bus=$(dirname "$bus")
+echo mcp9808 $ADDR > "$bus/new_device"
+
+"$HERE/alert_latency" -p "$pull" -n "${1:-1000}"
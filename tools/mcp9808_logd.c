@@ -0,0 +1,569 @@
+/*
+ * mcp9808_logd.c — Log every sample from many MCP9808 sensors to disk
+ *
+ * Each sensor is opened in binary mode at the requested rate and read in
+ * batches.  Samples are buffered per sensor and encoded into compact
+ * columnar blocks (delta-of-delta timestamps, delta raw register values,
+ * zigzag varints; about 3 bytes per sample instead of 24), which are
+ * collected in a large output buffer and written with one write() per
+ * megabyte.  Files rotate by size and age.
+ *
+ *   mcp9808_logd [-o dir] [-r rate_mhz] [-s max_mb] [-T max_s]
+ *                [-f flush_s] [dev...]
+ *   mcp9808_logd -D file          decode a log to text
+ *   mcp9808_logd -B sensors       benchmark the encode/write path
+ *
+ * File format, all integers little endian:
+ *   "MCP9808L" u16 version i64 realtime_ns i64 monotonic_ns
+ *   u16 nsensors { u16 len, name[len] }...
+ *   (the clock pair, read together at file creation, places the
+ *   CLOCK_MONOTONIC sample timestamps in wall time)
+ *   blocks: u32 "MCPB" u16 sensor u16 count u32 payload_len
+ *           i64 first_ts_us u16 first_raw
+ *           payload: (count-1) ts delta-of-delta, (count-1) raw deltas
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include "mcp9808.h"
+
+#define FILE_MAGIC    "MCP9808L"
+#define FILE_VERSION  2
+#define BLOCK_MAGIC   0x4250434d    /* "MCPB" */
+#define BLOCK         256           /* samples per encoded block */
+#define READ_BATCH    64            /* records per read() */
+#define WRITE_CHUNK   (1 << 20)     /* bytes buffered before write() */
+
+struct sensor {
+    const char *name;
+    int         fd;
+    unsigned int n;
+    int64_t     ts[BLOCK];          /* µs */
+    uint16_t    raw[BLOCK];
+};
+
+struct out {
+    const char *dir;
+    int         fd;
+    uint8_t    *buf;
+    size_t      len, cap;
+    uint64_t    file_bytes, max_bytes;
+    time_t      opened;
+    unsigned int max_age;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+static void die(const char *what)
+{
+    perror(what);
+    exit(1);
+}
+
+static double cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Output buffer */
+
+static void reserve(struct out *o, size_t n)
+{
+    if (o->len + n <= o->cap)
+        return;
+    while (o->len + n > o->cap)
+        o->cap = o->cap ? o->cap * 2 : WRITE_CHUNK * 2;
+    o->buf = realloc(o->buf, o->cap);
+    if (!o->buf)
+        die("realloc");
+}
+
+static void put_bytes(struct out *o, const void *p, size_t n)
+{
+    reserve(o, n);
+    memcpy(o->buf + o->len, p, n);
+    o->len += n;
+}
+
+static void put_le(struct out *o, uint64_t v, int bytes)
+{
+    reserve(o, bytes);
+    while (bytes--) {
+        o->buf[o->len++] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+static void put_varint(struct out *o, int64_t v)
+{
+    uint64_t z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);   /* zigzag */
+
+    reserve(o, 10);
+    while (z >= 0x80) {
+        o->buf[o->len++] = z | 0x80;
+        z >>= 7;
+    }
+    o->buf[o->len++] = z;
+}
+
+static void flush_out(struct out *o)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < o->len) {
+        n = write(o->fd, o->buf + off, o->len - off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            die("write");
+        }
+        off += n;
+    }
+    o->file_bytes += o->len;
+    o->len = 0;
+}
+
+/* Files */
+
+static int64_t ts_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+/* CLOCK_REALTIME with the CLOCK_MONOTONIC time it was read at */
+static void clock_pair(int64_t *real_ns, int64_t *mono_ns)
+{
+    struct timespec m0, r, m1;
+
+    clock_gettime(CLOCK_MONOTONIC, &m0);
+    clock_gettime(CLOCK_REALTIME, &r);
+    clock_gettime(CLOCK_MONOTONIC, &m1);
+    *real_ns = ts_ns(&r);
+    *mono_ns = ts_ns(&m0) + (ts_ns(&m1) - ts_ns(&m0)) / 2;
+}
+
+static void open_file(struct out *o, struct sensor *s, int ns)
+{
+    char path[4096], stamp[32];
+    time_t t = time(NULL);
+    int64_t real_ns, mono_ns;
+    int i, seq = 0;
+
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", gmtime(&t));
+    do {
+        snprintf(path, sizeof(path), "%s/mcp9808-%s%s%.0d.log", o->dir,
+                 stamp, seq ? "-" : "", seq);
+        o->fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        seq++;
+    } while (o->fd < 0 && errno == EEXIST);
+    if (o->fd < 0)
+        die(path);
+
+    o->file_bytes = 0;
+    o->opened = t;
+
+    put_bytes(o, FILE_MAGIC, 8);
+    put_le(o, FILE_VERSION, 2);
+    clock_pair(&real_ns, &mono_ns);
+    put_le(o, real_ns, 8);
+    put_le(o, mono_ns, 8);
+    put_le(o, ns, 2);
+    for (i = 0; i < ns; i++) {
+        put_le(o, strlen(s[i].name), 2);
+        put_bytes(o, s[i].name, strlen(s[i].name));
+    }
+}
+
+static void close_file(struct out *o)
+{
+    flush_out(o);
+    close(o->fd);
+}
+
+/* Encode the buffered samples of sensor idx as one block */
+static void encode_block(struct out *o, struct sensor *s, int idx)
+{
+    size_t len_at, payload_at;
+    int64_t prev_delta = 0, delta;
+    unsigned int i;
+
+    if (!s->n)
+        return;
+
+    put_le(o, BLOCK_MAGIC, 4);
+    put_le(o, idx, 2);
+    put_le(o, s->n, 2);
+    len_at = o->len;
+    put_le(o, 0, 4);
+    put_le(o, s->ts[0], 8);
+    put_le(o, s->raw[0], 2);
+
+    payload_at = o->len;
+    for (i = 1; i < s->n; i++) {
+        delta = s->ts[i] - s->ts[i - 1];
+        put_varint(o, delta - prev_delta);
+        prev_delta = delta;
+    }
+    for (i = 1; i < s->n; i++)
+        put_varint(o, (int16_t)(s->raw[i] - s->raw[i - 1]));
+
+    for (i = 0; i < 4; i++)
+        o->buf[len_at + i] = (o->len - payload_at) >> (8 * i);
+    s->n = 0;
+}
+
+static void add_sample(struct out *o, struct sensor *s, int idx,
+                       int64_t ts_us, uint16_t raw)
+{
+    s->ts[s->n]  = ts_us;
+    s->raw[s->n] = raw;
+    if (++s->n == BLOCK)
+        encode_block(o, s, idx);
+    if (o->len >= WRITE_CHUNK)
+        flush_out(o);
+}
+
+static void flush_all(struct out *o, struct sensor *s, int ns)
+{
+    int i;
+
+    for (i = 0; i < ns; i++)
+        encode_block(o, &s[i], i);
+    flush_out(o);
+}
+
+static void maybe_rotate(struct out *o, struct sensor *s, int ns)
+{
+    if ((o->max_bytes && o->file_bytes + o->len >= o->max_bytes) ||
+        (o->max_age && time(NULL) - o->opened >= o->max_age)) {
+        flush_all(o, s, ns);
+        close_file(o);
+        open_file(o, s, ns);
+    }
+}
+
+/* Daemon */
+
+static void drain(struct out *o, struct sensor *s, int idx)
+{
+    struct mcp9808_sample rec[READ_BATCH];
+    ssize_t n;
+    int i;
+
+    for (;;) {
+        n = read(s[idx].fd, rec, sizeof(rec));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                return;
+            die(s[idx].name);
+        }
+        for (i = 0; i < n / (ssize_t)sizeof(rec[0]); i++)
+            add_sample(o, &s[idx], idx, rec[i].timestamp_ns / 1000,
+                       rec[i].raw);
+        if (n < (ssize_t)sizeof(rec))
+            return;
+    }
+}
+
+static int run_daemon(struct out *o, struct sensor *s, int ns,
+                      unsigned int rate, unsigned int flush_s)
+{
+    unsigned int mode = MCP9808_MODE_BINARY;
+    struct epoll_event ev, events[64];
+    double last_flush = now();
+    int ep, i, n;
+
+    ep = epoll_create1(0);
+    if (ep < 0)
+        die("epoll_create1");
+
+    for (i = 0; i < ns; i++) {
+        s[i].fd = open(s[i].name, O_RDONLY | O_NONBLOCK);
+        if (s[i].fd < 0)
+            die(s[i].name);
+        if (ioctl(s[i].fd, MCP9808_IOC_SET_MODE, &mode) ||
+            ioctl(s[i].fd, MCP9808_IOC_SET_RATE, &rate))
+            die(s[i].name);
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, s[i].fd, &ev))
+            die("epoll_ctl");
+    }
+
+    open_file(o, s, ns);
+    while (!stop) {
+        n = epoll_wait(ep, events, 64, 1000);
+        if (n < 0 && errno != EINTR)
+            die("epoll_wait");
+        for (i = 0; i < n; i++)
+            drain(o, s, events[i].data.u32);
+
+        if (now() - last_flush >= flush_s) {
+            flush_all(o, s, ns);
+            last_flush = now();
+        }
+        maybe_rotate(o, s, ns);
+    }
+
+    flush_all(o, s, ns);
+    close_file(o);
+    return 0;
+}
+
+/* Decoder */
+
+static int get_le(FILE *f, int bytes, uint64_t *v)
+{
+    uint8_t b[8];
+    int i;
+
+    if (fread(b, 1, bytes, f) != (size_t)bytes)
+        return -1;
+    *v = 0;
+    for (i = bytes - 1; i >= 0; i--)
+        *v = (*v << 8) | b[i];
+    return 0;
+}
+
+static int64_t get_varint(const uint8_t **p)
+{
+    uint64_t z = 0;
+    int shift = 0;
+
+    while (**p & 0x80) {
+        z |= (uint64_t)(*(*p)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    z |= (uint64_t)*(*p)++ << shift;
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+static int run_dump(const char *path)
+{
+    uint64_t ver, ns, len, magic, idx, count, plen, ts, raw, real, mono;
+    int64_t delta = 0, *tss, wall;
+    uint16_t *raws;
+    uint8_t *payload;
+    const uint8_t *p;
+    char magic8[8];
+    unsigned int i;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (!f)
+        die(path);
+    if (fread(magic8, 1, 8, f) != 8 || memcmp(magic8, FILE_MAGIC, 8) ||
+        get_le(f, 2, &ver) || ver != FILE_VERSION || get_le(f, 8, &real) ||
+        get_le(f, 8, &mono) || get_le(f, 2, &ns)) {
+        fprintf(stderr, "%s: not a version %d log\n", path, FILE_VERSION);
+        return 1;
+    }
+    printf("# realtime_ns %lld at monotonic_ns %lld\n", (long long)real,
+           (long long)mono);
+    for (i = 0; i < ns; i++) {
+        char name[65536];
+
+        if (get_le(f, 2, &len) || fread(name, 1, len, f) != len)
+            return 1;
+        printf("# sensor %u %.*s\n", i, (int)len, name);
+    }
+
+    tss  = malloc(65536 * sizeof(*tss));
+    raws = malloc(65536 * sizeof(*raws));
+    while (!get_le(f, 4, &magic)) {
+        if (magic != BLOCK_MAGIC || get_le(f, 2, &idx) ||
+            get_le(f, 2, &count) || get_le(f, 4, &plen) ||
+            get_le(f, 8, &ts) || get_le(f, 2, &raw) || !count) {
+            fprintf(stderr, "%s: corrupt block\n", path);
+            return 1;
+        }
+        payload = malloc(plen + 20);    /* slack for a truncated varint */
+        memset(payload + plen, 0, 20);
+        if (fread(payload, 1, plen, f) != plen) {
+            fprintf(stderr, "%s: truncated block\n", path);
+            return 1;
+        }
+
+        p = payload;
+        tss[0]  = ts;
+        raws[0] = raw;
+        delta = 0;
+        for (i = 1; i < count; i++) {
+            delta += get_varint(&p);
+            tss[i] = tss[i - 1] + delta;
+        }
+        for (i = 1; i < count; i++)
+            raws[i] = raws[i - 1] + get_varint(&p);
+        free(payload);
+
+        for (i = 0; i < count; i++) {
+            /* same conversion as the driver: 1/16 °C in 13-bit two's complement */
+            int t = (int16_t)(raws[i] << 3) >> 3;
+
+            /* wall time in µs through the header's clock pair */
+            wall = tss[i] + ((int64_t)real - (int64_t)mono) / 1000;
+            printf("%u %lld.%06lld %.4f %u %lld.%06lld\n", (unsigned int)idx,
+                   (long long)(tss[i] / 1000000),
+                   (long long)(tss[i] % 1000000), t / 16.0, raws[i] >> 13,
+                   (long long)(wall / 1000000), (long long)(wall % 1000000));
+        }
+    }
+    free(tss);
+    free(raws);
+    fclose(f);
+    return 0;
+}
+
+/* Benchmark: synthetic 8 Hz sensors through the encode/write path */
+
+static void report(const char *name, unsigned long long samples,
+                   double wall, double cpu, uint64_t bytes)
+{
+    printf("%-10s %12.0f samples/s %8.3f us CPU/sample %6.2f bytes/sample\n",
+           name, samples / wall, cpu * 1e6 / samples,
+           (double)bytes / samples);
+}
+
+static int run_bench(struct out *o, int ns)
+{
+    const unsigned long long per_sensor = 200000;
+    struct sensor *s = calloc(ns, sizeof(*s));
+    struct mcp9808_sample rec = { 0 };
+    unsigned long long total = 0, k;
+    double t0, c0;
+    uint64_t bytes;
+    char path[4096];
+    int i, fd;
+
+    for (i = 0; i < ns; i++)
+        s[i].name = "synthetic";
+
+    /* baseline: one write() per sample of the raw record */
+    snprintf(path, sizeof(path), "%s/bench-per-sample.bin", o->dir);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        die(path);
+    t0 = now();
+    c0 = cpu_time();
+    for (k = 0; k < per_sensor; k++)
+        for (i = 0; i < ns; i++) {
+            rec.seq++;
+            rec.timestamp_ns = k * 125000000LL + (rand() % 4000) * 1000;
+            rec.raw = 0x0190 + (rand() % 5) - 2;
+            if (write(fd, &rec, sizeof(rec)) != sizeof(rec))
+                die("write");
+        }
+    report("per-sample", per_sensor * ns, now() - t0, cpu_time() - c0,
+           per_sensor * ns * sizeof(rec));
+    close(fd);
+    unlink(path);
+
+    /* daemon path: blocks in memory, one write() per WRITE_CHUNK */
+    o->max_bytes = 0;
+    o->max_age = 0;
+    open_file(o, s, ns);
+    t0 = now();
+    c0 = cpu_time();
+    for (k = 0; k < per_sensor; k++)
+        for (i = 0; i < ns; i++) {
+            add_sample(o, &s[i], i,
+                       k * 125000 + rand() % 4000, 0x0190 + (rand() % 5) - 2);
+            total++;
+        }
+    flush_all(o, s, ns);
+    bytes = o->file_bytes;
+    report("logd", total, now() - t0, cpu_time() - c0, bytes);
+    close_file(o);
+    free(s);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-o dir] [-r rate_mhz] [-s max_mb] [-T max_s] "
+            "[-f flush_s] [dev...]\n"
+            "       %s -D file\n"
+            "       %s [-o dir] -B sensors\n", prog, prog, prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct out o = { .dir = ".", .max_bytes = 64ULL << 20, .max_age = 3600 };
+    unsigned int rate = 1000, flush_s = 10;
+    int opt, ns, bench = 0, i;
+    struct sensor *s;
+    glob_t g = { 0 };
+
+    while ((opt = getopt(argc, argv, "o:r:s:T:f:D:B:")) != -1) {
+        switch (opt) {
+        case 'o': o.dir = optarg; break;
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 's': o.max_bytes = strtoull(optarg, NULL, 0) << 20; break;
+        case 'T': o.max_age = strtoul(optarg, NULL, 0); break;
+        case 'f': flush_s = strtoul(optarg, NULL, 0); break;
+        case 'D': return run_dump(optarg);
+        case 'B': bench = atoi(optarg); break;
+        default:  usage(argv[0]);
+        }
+    }
+
+    if (bench > 0)
+        return run_bench(&o, bench);
+
+    if (optind < argc) {
+        ns = argc - optind;
+        s = calloc(ns, sizeof(*s));
+        for (i = 0; i < ns; i++)
+            s[i].name = argv[optind + i];
+    } else {
+        glob("/dev/mcp9808", 0, NULL, &g);
+        glob("/dev/mcp9808-[0-9]*", GLOB_APPEND, NULL, &g);
+        if (!g.gl_pathc) {
+            fprintf(stderr, "no /dev/mcp9808* devices\n");
+            return 1;
+        }
+        ns = g.gl_pathc;
+        s = calloc(ns, sizeof(*s));
+        for (i = 0; i < ns; i++)
+            s[i].name = g.gl_pathv[i];
+    }
+    if (!s || ns > 65535)
+        usage(argv[0]);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    return run_daemon(&o, s, ns, rate, flush_s);
+}
@@ -0,0 +1,169 @@
+/*
+ * splice_bench.c — Compare read()/write() against splice() for
+ * streaming binary samples out of /dev/mcp9808
+ *
+ * Both methods run for the same time at the same rate and write to the
+ * same sink; the report gives records moved and CPU time per record.
+ * Sample production is bounded by the sensor, so CPU per record is the
+ * figure that matters.
+ *
+ *   splice_bench [-d dev] [-o out] [-r rate_mhz] [-t seconds]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include "mcp9808.h"
+
+#define BATCH  64           /* records per read() or splice() */
+
+struct result {
+    unsigned long long bytes;
+    double wall_s, cpu_s;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int open_stream(const char *dev, unsigned int rate)
+{
+    unsigned int mode = MCP9808_MODE_BINARY;
+    int fd = open(dev, O_RDONLY);
+
+    if (fd < 0) {
+        perror(dev);
+        exit(1);
+    }
+    if (ioctl(fd, MCP9808_IOC_SET_MODE, &mode) ||
+        ioctl(fd, MCP9808_IOC_SET_RATE, &rate)) {
+        perror("ioctl");
+        exit(1);
+    }
+    return fd;
+}
+
+static void run_copy(int in, int out, double secs, struct result *r)
+{
+    struct mcp9808_sample buf[BATCH];
+    double t0 = now(), c0 = cpu_time();
+    ssize_t n;
+
+    while (now() - t0 < secs) {
+        n = read(in, buf, sizeof(buf));
+        if (n < 0) {
+            perror("read");
+            exit(1);
+        }
+        if (write(out, buf, n) != n) {
+            perror("write");
+            exit(1);
+        }
+        r->bytes += n;
+    }
+    r->wall_s = now() - t0;
+    r->cpu_s  = cpu_time() - c0;
+}
+
+static void run_splice(int in, int out, double secs, struct result *r)
+{
+    const size_t len = BATCH * sizeof(struct mcp9808_sample);
+    double t0 = now(), c0 = cpu_time();
+    int pfd[2];
+    ssize_t n, m;
+
+    if (pipe(pfd)) {
+        perror("pipe");
+        exit(1);
+    }
+
+    while (now() - t0 < secs) {
+        n = splice(in, NULL, pfd[1], NULL, len, SPLICE_F_MOVE);
+        if (n < 0) {
+            perror("splice in");
+            exit(1);
+        }
+        while (n > 0) {
+            m = splice(pfd[0], NULL, out, NULL, n, SPLICE_F_MOVE);
+            if (m < 0) {
+                perror("splice out");
+                exit(1);
+            }
+            n -= m;
+            r->bytes += m;
+        }
+    }
+    r->wall_s = now() - t0;
+    r->cpu_s  = cpu_time() - c0;
+    close(pfd[0]);
+    close(pfd[1]);
+}
+
+static void report(const char *name, const struct result *r)
+{
+    unsigned long long recs = r->bytes / sizeof(struct mcp9808_sample);
+
+    printf("%-11s %10llu records %10.1f rec/s %10.2f us CPU/rec\n", name,
+           recs, recs / r->wall_s, recs ? r->cpu_s * 1e6 / recs : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dev = "/dev/mcp9808", *outp = "/dev/null";
+    unsigned int rate = 8000;
+    double secs = 10;
+    struct result copy = { 0 }, spl = { 0 };
+    int opt, in, out;
+
+    while ((opt = getopt(argc, argv, "d:o:r:t:")) != -1) {
+        switch (opt) {
+        case 'd': dev  = optarg; break;
+        case 'o': outp = optarg; break;
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 't': secs = strtod(optarg, NULL); break;
+        default:
+            fprintf(stderr, "usage: %s [-d dev] [-o out] [-r rate_mhz] "
+                            "[-t seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    out = open(outp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror(outp);
+        return 1;
+    }
+
+    in = open_stream(dev, rate);
+    run_copy(in, out, secs, &copy);
+    close(in);
+
+    in = open_stream(dev, rate);
+    run_splice(in, out, secs, &spl);
+    close(in);
+
+    report("read/write", &copy);
+    report("splice", &spl);
+    return 0;
+}